@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+// Every block of an `Arena` begins on a cache line.
+constexpr std::size_t arena_alignment = 64;
+// Blocks at least this large are aligned to, and rounded up to, a whole
+// number of huge pages, so that the kernel can back them with huge pages.
+constexpr std::size_t huge_page_size = std::size_t{2} << 20;
+
+// A bump allocator over a few large, aligned blocks of memory. Objects made
+// with `create()` are destroyed in the reverse order of their creation when
+// the arena is reset or destroyed, so an arena owns everything allocated
+// from it.
+//
+// An `Arena` is also a `std::pmr::memory_resource`, so that standard
+// containers can allocate scratch memory from it. Their deallocations do
+// nothing, and the memory is only reclaimed by `reset()`. Arenas are not
+// thread-safe.
+struct Arena final : std::pmr::memory_resource {
+    struct Block {
+        std::byte* p_memory;
+        std::size_t size;
+    };
+
+    struct Destructor {
+        void (*p_destroy)(void*);
+        void* p_object;
+    };
+
+    std::size_t block_size;
+    std::vector<Block> blocks;
+    // Allocations are bumped from `used` bytes into `blocks[current_block]`.
+    std::size_t current_block = 0;
+    std::size_t used = 0;
+    std::vector<Destructor> destructors;
+
+    explicit Arena(std::size_t const block_size) : block_size(block_size) {
+    }
+
+    Arena(Arena const&) = delete;
+    auto operator=(Arena const&) -> Arena& = delete;
+
+    ~Arena() override {
+        this->reset();
+        for (Block const& block : blocks) {
+            std::free(block.p_memory);
+        }
+    }
+
+    // Destroy every object, and rewind to the first block. The blocks are
+    // kept, so an arena which is reset every frame stops allocating once it
+    // has grown to fit a frame.
+    void reset() {
+        for (auto it = destructors.rbegin(); it != destructors.rend(); ++it) {
+            it->p_destroy(it->p_object);
+        }
+        destructors.clear();
+        current_block = 0;
+        used = 0;
+    }
+
+    // Returns `nullptr` if no more memory could be allocated.
+    auto allocate_bytes(std::size_t const size, std::size_t const alignment)
+        -> void* {
+        for (; current_block < blocks.size(); current_block++, used = 0) {
+            Block const& block = blocks[current_block];
+            auto address = reinterpret_cast<std::uintptr_t>(block.p_memory);
+            std::size_t offset =
+                (address + used + alignment - 1) / alignment * alignment -
+                address;
+            if (offset + size <= block.size) {
+                used = offset + size;
+                return block.p_memory + offset;
+            }
+        }
+
+        std::size_t new_block_alignment =
+            std::max({arena_alignment, alignment,
+                      block_size >= huge_page_size ? huge_page_size : 0});
+        std::size_t new_block_size =
+            (std::max(block_size, size) + new_block_alignment - 1) /
+            new_block_alignment * new_block_alignment;
+        auto p_memory = static_cast<std::byte*>(
+            std::aligned_alloc(new_block_alignment, new_block_size));
+        if (p_memory == nullptr) {
+            return nullptr;
+        }
+#if defined(__linux__)
+        if (new_block_alignment == huge_page_size) {
+            // This is only advice, so failing to take it is harmless.
+            madvise(p_memory, new_block_size, MADV_HUGEPAGE);
+        }
+#endif
+        blocks.push_back({p_memory, new_block_size});
+        current_block = blocks.size() - 1;
+        used = size;
+        return p_memory;
+    }
+
+    // Construct a `T` in this arena, or return `nullptr` if it does not fit.
+    // It is destroyed by `reset()`.
+    template <typename T, typename... Arguments>
+    auto create(Arguments&&... arguments) -> T* {
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            // Reserve the destructor's slot first, so that a `T` is never
+            // left without one.
+            destructors.reserve(destructors.size() + 1);
+        }
+        void* p_memory = this->allocate_bytes(sizeof(T), alignof(T));
+        if (p_memory == nullptr) {
+            return nullptr;
+        }
+        T* p_object = new (p_memory) T(std::forward<Arguments>(arguments)...);
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            destructors.push_back({[](void* p_object) {
+                                       static_cast<T*>(p_object)->~T();
+                                   },
+                                   p_object});
+        }
+        return p_object;
+    }
+
+    // Allocate `count` default-initialized `T`s, which must be trivially
+    // destructible, or return `nullptr` if they do not fit.
+    template <typename T>
+    auto create_array(std::size_t const count) -> T* {
+        static_assert(std::is_trivially_destructible_v<T>);
+        void* p_memory = this->allocate_bytes(sizeof(T) * count, alignof(T));
+        if (p_memory == nullptr) {
+            return nullptr;
+        }
+        auto p_array = static_cast<T*>(p_memory);
+        std::uninitialized_default_construct_n(p_array, count);
+        return p_array;
+    }
+
+  private:
+    auto do_allocate(std::size_t const size, std::size_t const alignment)
+        -> void* override {
+        void* p_memory = this->allocate_bytes(size, alignment);
+        if (p_memory == nullptr) {
+            throw std::bad_alloc();
+        }
+        return p_memory;
+    }
+
+    void do_deallocate(void*, std::size_t, std::size_t) override {
+    }
+
+    auto do_is_equal(std::pmr::memory_resource const& other) const noexcept
+        -> bool override {
+        return this == &other;
+    }
+};
@@ -0,0 +1,212 @@
+// Times every stage of a frame over deterministic scenes, and reports the
+// median and 99th percentile of each stage, so that regressions show up
+// without the noise of event polling and presentation.
+//
+// `--iterations <count>` sets how many frames are timed per scene, after a
+// few warm-up frames. `--threads <count>`, `--serial` and `--shadows
+// full|checkerboard|half` work as they do for `alternative`.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// The benchmark runs the same stages as `alternative`, so it measures exactly
+// the code which the game runs.
+#include "./renderer.hpp"
+
+constexpr int benchmark_warm_up_count = 3;
+constexpr int dense_box_count = 5'000;
+constexpr int many_light_count = 32;
+// The texture which lighting writes into is padded like one which SDL might
+// lock, so that the pitched path is what gets measured.
+constexpr int benchmark_texture_pitch = view_width + 16;
+
+struct BenchmarkScene {
+    std::string_view name;
+    void (*p_build)(Entities<entity_count>*, std::vector<Light>&);
+};
+
+void build_graybox_scene(Entities<entity_count>* p_entities,
+                         std::vector<Light>& lights) {
+    insert_graybox_world(p_entities);
+    lights.push_back(
+        {.x = view_width, .y = view_height / 2, .z = view_length / 4});
+}
+
+// Boxes scattered at random through the whole view. The raw output of
+// `std::mt19937` is specified by the standard, unlike its distributions, so
+// this scene is the same on every platform. Every box is the size of the
+// tile sprite, which is the only size that tracing supports.
+void build_dense_scene(Entities<entity_count>* p_entities,
+                       std::vector<Light>& lights) {
+    std::mt19937 random(1);
+    for (int i = 0; i < dense_box_count; i++) {
+        short x = static_cast<short>(random() % view_width);
+        short y = static_cast<short>(random() % (view_height / 2));
+        short z = static_cast<short>(random() % view_length);
+        p_entities->insert({
+            .aabb = {.position = {x, y, z}, .extent = {20, 20, 20}},
+        });
+    }
+    lights.push_back(
+        {.x = view_width, .y = view_height / 2, .z = view_length / 4});
+}
+
+// The graybox lit by a grid of small lights, each of which only reaches a
+// part of the view.
+void build_many_lights_scene(Entities<entity_count>* p_entities,
+                             std::vector<Light>& lights) {
+    insert_graybox_world(p_entities);
+    for (int i = 0; i < many_light_count; i++) {
+        lights.push_back({
+            .x = static_cast<short>(i % 8 * view_width / 7),
+            .y = 40,
+            .z = static_cast<short>(i / 8 * view_length / 3),
+            .radius = 120,
+        });
+    }
+}
+
+constexpr std::array<BenchmarkScene, 3> benchmark_scenes = {{
+    {"graybox", build_graybox_scene},
+    {"dense", build_dense_scene},
+    {"many_lights", build_many_lights_scene},
+}};
+
+// The microseconds which `function` takes to run.
+template <typename Function>
+auto time_stage(Function&& function) -> double {
+    auto begin = std::chrono::steady_clock::now();
+    function();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(end - begin).count();
+}
+
+// The nearest-rank percentile of `samples`, for a `fraction` in `(0, 1]`.
+auto percentile(std::vector<double> samples, double const fraction)
+    -> double {
+    std::sort(samples.begin(), samples.end());
+    auto rank = static_cast<std::size_t>(
+        std::ceil(fraction * static_cast<double>(samples.size())));
+    return samples[std::clamp<std::size_t>(rank, 1, samples.size()) - 1];
+}
+
+auto main(int argc, char** argv) -> int {
+    int iteration_count = 100;
+    int thread_count = static_cast<int>(std::thread::hardware_concurrency());
+    bool is_serial = false;
+    ShadowQuality shadow_quality = ShadowQuality::full;
+    for (int i = 1; i < argc; i++) {
+        std::string_view argument = argv[i];
+        if (argument == "--iterations" && i + 1 < argc) {
+            iteration_count = std::max(1, std::atoi(argv[i + 1]));
+            i++;
+        } else if (argument == "--threads" && i + 1 < argc) {
+            thread_count = std::atoi(argv[i + 1]);
+            i++;
+        } else if (argument == "--serial") {
+            is_serial = true;
+        } else if (argument == "--shadows" && i + 1 < argc) {
+            if (!parse_shadow_quality(argv[i + 1], shadow_quality)) {
+                std::cerr << "Unknown shadow quality " << argv[i + 1] << "\n";
+                return 1;
+            }
+            i++;
+        }
+    }
+    ThreadPool thread_pool(thread_count);
+
+    // Buffers which outlive every scene, and those which belong to one
+    // scene, are allocated as they are for `alternative`.
+    Arena buffer_arena(world_arena_block_size);
+    auto p_g_buffer = buffer_arena.create<GBuffer>();
+    // This stands in for the texture which SDL would lock.
+    Color* p_texture = buffer_arena.create_array<Color>(
+        view_height * benchmark_texture_pitch);
+    if (p_g_buffer == nullptr || p_texture == nullptr) {
+        return 1;
+    }
+    Arena frame_arena(frame_arena_block_size);
+    Arena scene_arena(world_arena_block_size);
+
+    std::cout << std::left << std::setw(14) << "scene" << std::setw(8)
+              << "stage" << std::right << std::setw(14) << "median (us)"
+              << std::setw(14) << "p99 (us)" << "\n";
+
+    for (BenchmarkScene const& scene : benchmark_scenes) {
+        scene_arena.reset();
+        auto p_entities =
+            scene_arena.create<Entities<entity_count>>(&scene_arena);
+        auto p_view_hash = scene_arena.create<ViewHash>(&scene_arena);
+        auto p_light_bins = scene_arena.create<LightBins>(&scene_arena);
+        // Every frame rebuilds the bins, which invalidates this entirely, so
+        // lighting is always measured without caching.
+        auto p_shadow_cache = scene_arena.create<ShadowCache>();
+        if (p_entities == nullptr || p_view_hash == nullptr ||
+            p_light_bins == nullptr || p_shadow_cache == nullptr) {
+            return 1;
+        }
+        std::vector<Light> lights;
+        scene.p_build(p_entities, lights);
+
+        std::array<std::string_view, 3> stage_names = {"bin", "trace",
+                                                       "light"};
+        std::array<std::vector<double>, 3> stage_times;
+
+        for (int i = 0; i < benchmark_warm_up_count + iteration_count; i++) {
+            std::array<double, 3> times = {
+                time_stage([&] {
+                    frame_arena.reset();
+                    count_entities_in_bins(p_entities, p_view_hash,
+                                           &frame_arena);
+                }),
+                time_stage([&] {
+                    if (is_serial) {
+                        trace_hash_for_pixel(p_entities, p_view_hash,
+                                             p_g_buffer);
+                    } else {
+                        trace_hash_for_pixel(thread_pool, p_entities,
+                                             p_view_hash, p_g_buffer);
+                    }
+                }),
+                time_stage([&] {
+                    bin_lights(lights, p_view_hash, p_light_bins,
+                               &frame_arena);
+                    if (is_serial) {
+                        light_pixels(lights, p_light_bins, p_view_hash,
+                                     p_shadow_cache, shadow_quality,
+                                     p_g_buffer, p_texture,
+                                     benchmark_texture_pitch);
+                    } else {
+                        light_pixels(thread_pool, lights, p_light_bins,
+                                     p_view_hash, p_shadow_cache,
+                                     shadow_quality, p_g_buffer, p_texture,
+                                     benchmark_texture_pitch);
+                    }
+                }),
+            };
+            if (i < benchmark_warm_up_count) {
+                continue;
+            }
+            for (std::size_t stage = 0; stage < times.size(); stage++) {
+                stage_times[stage].push_back(times[stage]);
+            }
+        }
+
+        std::cout << std::fixed << std::setprecision(1);
+        for (std::size_t stage = 0; stage < stage_names.size(); stage++) {
+            std::cout << std::left << std::setw(14) << scene.name
+                      << std::setw(8) << stage_names[stage] << std::right
+                      << std::setw(14) << percentile(stage_times[stage], 0.5)
+                      << std::setw(14) << percentile(stage_times[stage], 0.99)
+                      << "\n";
+        }
+    }
+}
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "./sprites.hpp"
+
+// The formats a headless render can write its frames in.
+enum class ImageFormat {
+    // Binary netpbm. Several frames in one file form a valid PPM stream.
+    ppm,
+    // Truecolor PNG, stored without compression so it needs no `zlib`.
+    png,
+    // Headerless 8-bit RGBA, one frame after another, for piping into
+    // an encoder such as `ffmpeg -f rawvideo -pix_fmt rgba`.
+    raw,
+};
+
+// Pick a format from the extension of `path`. Anything which is not a
+// `.ppm` or a `.png` is written raw.
+inline auto image_format_for_path(std::string_view const path)
+    -> ImageFormat {
+    if (path.ends_with(".ppm")) {
+        return ImageFormat::ppm;
+    }
+    if (path.ends_with(".png")) {
+        return ImageFormat::png;
+    }
+    return ImageFormat::raw;
+}
+
+// Replace the first run of `#` in `pattern` with `frame_index`, padded with
+// zeros to the length of that run. Returns `pattern` unchanged if it has no
+// `#`, so that every frame is written to the same path.
+inline auto image_path_for_frame(std::string_view const pattern,
+                                 int const frame_index) -> std::string {
+    std::size_t begin = pattern.find('#');
+    if (begin == std::string_view::npos) {
+        return std::string(pattern);
+    }
+    std::size_t end = pattern.find_first_not_of('#', begin);
+    if (end == std::string_view::npos) {
+        end = pattern.size();
+    }
+
+    std::string number = std::to_string(frame_index);
+    if (number.size() < end - begin) {
+        number.insert(0, end - begin - number.size(), '0');
+    }
+    return std::string(pattern.substr(0, begin)) + number +
+           std::string(pattern.substr(end));
+}
+
+// The window shows frames through an `SDL_PIXELFORMAT_RGB888` texture, which
+// on a little-endian host reads a `Color`'s bytes as blue, green, red. Images
+// are written in that displayed order, so that they match the window exactly.
+inline auto displayed_rgb(Color const color) -> std::array<char, 3> {
+    return {static_cast<char>(color.blue), static_cast<char>(color.green),
+            static_cast<char>(color.red)};
+}
+
+inline void write_ppm(std::ostream& stream, Color const* p_image,
+                      int const width, int const height) {
+    stream << "P6\n" << width << " " << height << "\n255\n";
+    for (int i = 0; i < width * height; i++) {
+        std::array<char, 3> rgb = displayed_rgb(p_image[i]);
+        stream.write(rgb.data(), 3);
+    }
+}
+
+// `Color::alpha` is never set by the renderer, and the window ignores it, so
+// every pixel is written fully opaque.
+inline void write_raw(std::ostream& stream, Color const* p_image,
+                      int const width, int const height) {
+    for (int i = 0; i < width * height; i++) {
+        std::array<char, 3> rgb = displayed_rgb(p_image[i]);
+        stream.write(rgb.data(), 3);
+        stream.put(static_cast<char>(255));
+    }
+}
+
+// The CRC-32 which checksums every PNG chunk.
+constexpr auto png_crc_table = []() {
+    std::array<std::uint32_t, 256> table{};
+    for (std::uint32_t i = 0; i < 256; i++) {
+        std::uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1u) ? 0xedb88320u ^ (crc >> 1) : crc >> 1;
+        }
+        table[i] = crc;
+    }
+    return table;
+}();
+
+// PNG stores integers big-endian.
+inline void write_png_u32(std::ostream& stream, std::uint32_t const value) {
+    char bytes[4] = {static_cast<char>(value >> 24),
+                     static_cast<char>(value >> 16),
+                     static_cast<char>(value >> 8), static_cast<char>(value)};
+    stream.write(bytes, 4);
+}
+
+// A chunk is built up in `data`, then written with its length and CRC.
+struct PngChunk {
+    std::string data;
+
+    explicit PngChunk(std::string_view const type) : data(type) {
+    }
+
+    void push_u8(unsigned int const value) {
+        data.push_back(static_cast<char>(value & 0xffu));
+    }
+
+    void push_u16_little(unsigned int const value) {
+        this->push_u8(value);
+        this->push_u8(value >> 8);
+    }
+
+    void push_u32(std::uint32_t const value) {
+        this->push_u8(value >> 24);
+        this->push_u8(value >> 16);
+        this->push_u8(value >> 8);
+        this->push_u8(value);
+    }
+
+    void write(std::ostream& stream) const {
+        std::uint32_t crc = 0xffffffffu;
+        for (char const byte : data) {
+            crc = png_crc_table[(crc ^ static_cast<unsigned char>(byte)) &
+                                0xffu] ^
+                  (crc >> 8);
+        }
+
+        // The chunk's type is part of `data`, but not of its length.
+        write_png_u32(stream, static_cast<std::uint32_t>(data.size() - 4));
+        stream.write(data.data(), static_cast<std::streamsize>(data.size()));
+        write_png_u32(stream, crc ^ 0xffffffffu);
+    }
+};
+
+inline void write_png(std::ostream& stream, Color const* p_image,
+                      int const width, int const height) {
+    stream.write("\x89PNG\r\n\x1a\n", 8);
+
+    PngChunk header("IHDR");
+    header.push_u32(static_cast<std::uint32_t>(width));
+    header.push_u32(static_cast<std::uint32_t>(height));
+    // 8-bit truecolor, with the default compression, filtering and no
+    // interlacing.
+    header.push_u8(8);
+    header.push_u8(2);
+    header.push_u8(0);
+    header.push_u8(0);
+    header.push_u8(0);
+    header.write(stream);
+
+    // Every scanline begins with a filter byte of `0`, for no filtering.
+    std::string scanlines;
+    scanlines.reserve(static_cast<std::size_t>((width * 3 + 1) * height));
+    for (int j = 0; j < height; j++) {
+        scanlines.push_back(0);
+        for (int i = 0; i < width; i++) {
+            std::array<char, 3> rgb = displayed_rgb(p_image[i + j * width]);
+            scanlines.append(rgb.data(), 3);
+        }
+    }
+
+    // A zlib stream of uncompressed deflate blocks, which hold at most
+    // 65535 bytes each.
+    PngChunk data("IDAT");
+    data.push_u8(0x78);
+    data.push_u8(0x01);
+    std::size_t constexpr max_block_size = 65535;
+    std::size_t offset = 0;
+    do {
+        std::size_t block_size =
+            std::min(max_block_size, scanlines.size() - offset);
+        bool is_final = offset + block_size == scanlines.size();
+        data.push_u8(is_final ? 1 : 0);
+        data.push_u16_little(static_cast<unsigned int>(block_size));
+        data.push_u16_little(~static_cast<unsigned int>(block_size));
+        data.data.append(scanlines, offset, block_size);
+        offset += block_size;
+    } while (offset < scanlines.size());
+
+    std::uint32_t adler_low = 1;
+    std::uint32_t adler_high = 0;
+    for (char const byte : scanlines) {
+        adler_low = (adler_low + static_cast<unsigned char>(byte)) % 65521;
+        adler_high = (adler_high + adler_low) % 65521;
+    }
+    data.push_u32((adler_high << 16) | adler_low);
+    data.write(stream);
+
+    PngChunk("IEND").write(stream);
+}
+
+inline void write_image(std::ostream& stream, ImageFormat const format,
+                        Color const* p_image, int const width,
+                        int const height) {
+    switch (format) {
+        case ImageFormat::ppm:
+            write_ppm(stream, p_image, width, height);
+            break;
+        case ImageFormat::png:
+            write_png(stream, p_image, width, height);
+            break;
+        case ImageFormat::raw:
+            write_raw(stream, p_image, width, height);
+            break;
+    }
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <ostream>
+#include <string_view>
+#include <thread>
+
+// One formatted message. Longer messages are truncated.
+struct LogEntry {
+    std::array<char, 128> text;
+    int length;
+};
+
+// A fixed-capacity queue of `LogEntry`s for exactly one producer thread and
+// one consumer thread. Neither side ever blocks or allocates: the producer
+// drops a message when the queue is full, and the consumer finds nothing
+// when it is empty.
+template <int capacity>
+struct LogRing {
+    static_assert(std::has_single_bit(static_cast<unsigned>(capacity)),
+                  "A ring's capacity must be a power of two.");
+
+    std::array<LogEntry, capacity> entries;
+    // The producer and consumer each own one index, on separate cache lines
+    // so that they do not falsely share them.
+    alignas(64) std::atomic<unsigned> write_index = 0;
+    alignas(64) std::atomic<unsigned> read_index = 0;
+
+    // Reserve the next entry for writing, or return `nullptr` if the ring is
+    // full. It is published by `commit_write()`.
+    auto begin_write() -> LogEntry* {
+        unsigned write = write_index.load(std::memory_order_relaxed);
+        unsigned read = read_index.load(std::memory_order_acquire);
+        if (write - read == capacity) {
+            return nullptr;
+        }
+        return &entries[write % capacity];
+    }
+
+    void commit_write() {
+        write_index.store(write_index.load(std::memory_order_relaxed) + 1,
+                          std::memory_order_release);
+    }
+
+    // Copy out the oldest entry, if there is one.
+    auto pop(LogEntry& entry) -> bool {
+        unsigned read = read_index.load(std::memory_order_relaxed);
+        unsigned write = write_index.load(std::memory_order_acquire);
+        if (read == write) {
+            return false;
+        }
+        entry = entries[read % capacity];
+        read_index.store(read + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+// Formats messages on the render thread into a `LogRing`, which a background
+// thread drains to `stream`. Only one thread may call `log()`.
+struct Logger {
+    static constexpr int ring_capacity = 1024;
+    static constexpr std::chrono::milliseconds drain_interval{10};
+
+    LogRing<ring_capacity> ring;
+    std::ostream& stream;
+    std::atomic<unsigned> dropped_count = 0;
+    std::atomic<bool> is_stopping = false;
+    std::thread drain_thread;
+
+    explicit Logger(std::ostream& stream) : stream(stream) {
+        drain_thread = std::thread([this] {
+            this->drain();
+        });
+    }
+
+    Logger(Logger const&) = delete;
+    auto operator=(Logger const&) -> Logger& = delete;
+
+    // Everything logged before this is written out before it returns.
+    ~Logger() {
+        is_stopping.store(true, std::memory_order_release);
+        drain_thread.join();
+    }
+
+    // Format a message like `std::snprintf()` and queue it. This never
+    // blocks, and the message is dropped if the queue is full.
+    template <typename... Arguments>
+    void log(char const* p_format, Arguments const... arguments) {
+        LogEntry* p_entry = ring.begin_write();
+        if (p_entry == nullptr) {
+            dropped_count.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        int length = std::snprintf(p_entry->text.data(), p_entry->text.size(),
+                                   p_format, arguments...);
+        p_entry->length =
+            std::clamp(length, 0, static_cast<int>(p_entry->text.size()) - 1);
+        ring.commit_write();
+    }
+
+  private:
+    void drain() {
+        LogEntry entry;
+        unsigned reported_dropped_count = 0;
+        while (true) {
+            // Read the flag first, so that no message logged before stopping
+            // can be missed by the final pass.
+            bool is_last_pass = is_stopping.load(std::memory_order_acquire);
+            bool has_written = false;
+            while (ring.pop(entry)) {
+                stream << std::string_view(entry.text.data(), entry.length)
+                       << "\n";
+                has_written = true;
+            }
+
+            unsigned dropped = dropped_count.load(std::memory_order_relaxed);
+            if (dropped != reported_dropped_count) {
+                stream << "(" << dropped - reported_dropped_count
+                       << " log messages dropped)\n";
+                reported_dropped_count = dropped;
+                has_written = true;
+            }
+            if (has_written) {
+                stream.flush();
+            }
+
+            if (is_last_pass) {
+                return;
+            }
+            std::this_thread::sleep_for(drain_interval);
+        }
+    }
+};
@@ -0,0 +1,344 @@
+#pragma once
+
+// Per-frame instrumentation of the renderer's stages and hot loops. It is
+// compiled in by defining `ALTERNATIVE_PROFILE` to `1`. Otherwise, every
+// `PROFILE_*` macro expands to nothing, so it costs nothing.
+#if ALTERNATIVE_PROFILE
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "./sprites.hpp"
+
+// The stages of a frame which are timed. Binning, then primary tracing, then
+// shadow tracing run one after another on the thread which renders the frame,
+// even when their work is spread across a `ThreadPool`. Unless `--serial` is
+// given, that is a separate render thread, while the main thread presents the
+// frame before, or a headless run writes it out. That `present` time is
+// therefore recorded with the frame which rendered alongside it, one frame
+// after the frame it presented.
+enum class ProfileStage {
+    bin,
+    primary_trace,
+    shadow_trace,
+    present,
+};
+
+constexpr int profile_stage_count = 4;
+constexpr std::array<std::string_view, profile_stage_count>
+    profile_stage_names = {"bin", "primary_trace", "shadow_trace", "present"};
+
+// Every thread counts into its own `ProfileCounters`, so that the hot loops
+// never contend on shared memory.
+struct ProfileCounters {
+    std::uint64_t bins_visited = 0;
+    // Every box which a ray is tested against, however it is tested.
+    std::uint64_t aabb_tests = 0;
+    // Calls to `intersect_aabbs()`, each of which tests up to
+    // `aabb_lane_count` boxes.
+    std::uint64_t kernel_calls = 0;
+    std::uint64_t early_terminated_rays = 0;
+
+    void add(ProfileCounters const& counters) {
+        bins_visited += counters.bins_visited;
+        aabb_tests += counters.aabb_tests;
+        kernel_calls += counters.kernel_calls;
+        early_terminated_rays += counters.early_terminated_rays;
+    }
+
+    void reset() {
+        bins_visited = 0;
+        aabb_tests = 0;
+        kernel_calls = 0;
+        early_terminated_rays = 0;
+    }
+};
+
+// A 3x5 pixel font for the overlay. Each glyph is five rows of three bits,
+// from the top row down, with the most significant bit on the left.
+constexpr auto overlay_font = []() {
+    std::array<std::uint16_t, 128> glyphs{};
+    glyphs['0'] = 0b111'101'101'101'111;
+    glyphs['1'] = 0b010'110'010'010'111;
+    glyphs['2'] = 0b111'001'111'100'111;
+    glyphs['3'] = 0b111'001'111'001'111;
+    glyphs['4'] = 0b101'101'111'001'001;
+    glyphs['5'] = 0b111'100'111'001'111;
+    glyphs['6'] = 0b111'100'111'101'111;
+    glyphs['7'] = 0b111'001'001'001'001;
+    glyphs['8'] = 0b111'101'111'101'111;
+    glyphs['9'] = 0b111'101'111'001'111;
+    glyphs['A'] = 0b010'101'111'101'101;
+    glyphs['B'] = 0b110'101'110'101'110;
+    glyphs['C'] = 0b011'100'100'100'011;
+    glyphs['D'] = 0b110'101'101'101'110;
+    glyphs['E'] = 0b111'100'110'100'111;
+    glyphs['F'] = 0b111'100'110'100'100;
+    glyphs['G'] = 0b011'100'101'101'011;
+    glyphs['H'] = 0b101'101'111'101'101;
+    glyphs['I'] = 0b111'010'010'010'111;
+    glyphs['J'] = 0b001'001'001'101'010;
+    glyphs['K'] = 0b101'101'110'101'101;
+    glyphs['L'] = 0b100'100'100'100'111;
+    glyphs['M'] = 0b101'111'111'101'101;
+    glyphs['N'] = 0b110'101'101'101'101;
+    glyphs['O'] = 0b010'101'101'101'010;
+    glyphs['P'] = 0b110'101'110'100'100;
+    glyphs['Q'] = 0b010'101'101'110'011;
+    glyphs['R'] = 0b110'101'110'101'101;
+    glyphs['S'] = 0b011'100'010'001'110;
+    glyphs['T'] = 0b111'010'010'010'010;
+    glyphs['U'] = 0b101'101'101'101'111;
+    glyphs['V'] = 0b101'101'101'101'010;
+    glyphs['W'] = 0b101'101'111'111'101;
+    glyphs['X'] = 0b101'101'010'101'101;
+    glyphs['Y'] = 0b101'101'010'010'010;
+    glyphs['Z'] = 0b111'001'010'100'111;
+    glyphs['.'] = 0b000'000'000'000'010;
+    glyphs[':'] = 0b000'010'000'010'000;
+    glyphs['-'] = 0b000'000'111'000'000;
+    return glyphs;
+}();
+
+constexpr int overlay_glyph_width = 3;
+constexpr int overlay_glyph_height = 5;
+constexpr int overlay_scale = 2;
+
+// Draw `text` into `p_image`, whose rows are `pitch` `Color`s apart, with its
+// top-left corner at `x`, `y`. Only digits, capital letters and `.:-` are
+// drawn, and anything else is a space.
+inline void draw_overlay_text(Color* p_image, int const width,
+                              int const height, int const pitch, int x,
+                              int const y, std::string_view const text,
+                              Color const color) {
+    for (char const character : text) {
+        std::uint16_t glyph =
+            overlay_font[static_cast<unsigned char>(character) & 0x7fu];
+        for (int row = 0; row < overlay_glyph_height * overlay_scale; row++) {
+            for (int column = 0; column < overlay_glyph_width * overlay_scale;
+                 column++) {
+                int bit = (overlay_glyph_height - 1 - row / overlay_scale) *
+                              overlay_glyph_width +
+                          (overlay_glyph_width - 1 - column / overlay_scale);
+                int pixel_x = x + column;
+                int pixel_y = y + row;
+                if ((glyph >> bit & 1u) != 0 && pixel_x >= 0 &&
+                    pixel_x < width && pixel_y >= 0 && pixel_y < height) {
+                    p_image[pixel_x + pixel_y * pitch] = color;
+                }
+            }
+        }
+        x += (overlay_glyph_width + 1) * overlay_scale;
+    }
+}
+
+struct Profiler {
+    // The totals of the last finished frame, which the overlay shows.
+    std::array<double, profile_stage_count> stage_milliseconds{};
+    ProfileCounters counters;
+
+    std::array<double, profile_stage_count> current_stage_milliseconds{};
+    std::mutex mutex;
+    std::vector<ProfileCounters*> thread_counters;
+    // What threads which exited during this frame counted before they did.
+    ProfileCounters exited_thread_counters;
+
+    std::ofstream trace_file;
+    bool is_json = false;
+    int frame_index = 0;
+    bool is_overlay_visible = true;
+
+    ~Profiler() {
+        if (is_json && trace_file.is_open()) {
+            trace_file << "\n]\n";
+        }
+    }
+
+    // Write every frame to `path`, as JSON if it ends with `.json` and as
+    // CSV otherwise.
+    auto open_trace(std::string_view const path) -> bool {
+        trace_file.open(std::string(path), std::ios::trunc);
+        is_json = path.ends_with(".json");
+        if (is_json) {
+            trace_file << "[";
+        } else {
+            trace_file << "frame";
+            for (std::string_view const name : profile_stage_names) {
+                trace_file << "," << name << "_ms";
+            }
+            trace_file << ",bins_visited,aabb_tests,kernel_calls,"
+                          "early_terminated_rays\n";
+        }
+        return trace_file.good();
+    }
+
+    // A thread's counters are registered until the thread exits, when
+    // `unregister_thread()` must be called.
+    void register_thread(ProfileCounters& thread_counters) {
+        std::lock_guard lock(mutex);
+        this->thread_counters.push_back(&thread_counters);
+    }
+
+    // Stop gathering from a thread's counters, keeping what they have
+    // counted in this frame.
+    void unregister_thread(ProfileCounters& thread_counters) {
+        std::lock_guard lock(mutex);
+        exited_thread_counters.add(thread_counters);
+        std::erase(this->thread_counters, &thread_counters);
+    }
+
+    void add_stage_time(ProfileStage const stage, double const milliseconds) {
+        current_stage_milliseconds[static_cast<int>(stage)] += milliseconds;
+    }
+
+    // Gather the frame's counters from every thread, and write the frame to
+    // the trace. This must not overlap with any counting.
+    void end_frame() {
+        std::lock_guard lock(mutex);
+        counters = exited_thread_counters;
+        exited_thread_counters.reset();
+        for (ProfileCounters* p_counters : thread_counters) {
+            counters.add(*p_counters);
+            p_counters->reset();
+        }
+        stage_milliseconds = current_stage_milliseconds;
+        current_stage_milliseconds = {};
+
+        if (trace_file.is_open()) {
+            this->write_trace_frame();
+        }
+        frame_index++;
+    }
+
+    void write_trace_frame() {
+        if (is_json) {
+            trace_file << (frame_index == 0 ? "\n" : ",\n") << "{\"frame\":"
+                       << frame_index;
+            for (int i = 0; i < profile_stage_count; i++) {
+                trace_file << ",\"" << profile_stage_names[i]
+                           << "_ms\":" << stage_milliseconds[i];
+            }
+            trace_file << ",\"bins_visited\":" << counters.bins_visited
+                       << ",\"aabb_tests\":" << counters.aabb_tests
+                       << ",\"kernel_calls\":" << counters.kernel_calls
+                       << ",\"early_terminated_rays\":"
+                       << counters.early_terminated_rays << "}";
+        } else {
+            trace_file << frame_index;
+            for (double const milliseconds : stage_milliseconds) {
+                trace_file << "," << milliseconds;
+            }
+            trace_file << "," << counters.bins_visited << ","
+                       << counters.aabb_tests << ","
+                       << counters.kernel_calls << ","
+                       << counters.early_terminated_rays << "\n";
+        }
+    }
+
+    // Draw the last frame's stage times and counters over `p_image`, whose
+    // rows are `pitch` `Color`s apart.
+    void draw_overlay(Color* p_image, int const width, int const height,
+                      int const pitch) {
+        constexpr int line_height = (overlay_glyph_height + 2) * overlay_scale;
+        constexpr Color background = {0, 0, 0, 255};
+        constexpr Color foreground = {255, 255, 0, 255};
+
+        constexpr int line_count = profile_stage_count + 4;
+        std::array<char, 64> lines[line_count];
+        std::array<std::string_view, profile_stage_count> labels = {
+            "BIN", "PRIMARY", "SHADOW", "PRESENT"};
+        for (int i = 0; i < profile_stage_count; i++) {
+            std::snprintf(lines[i].data(), lines[i].size(), "%-8s%7.2f MS",
+                          labels[i].data(), stage_milliseconds[i]);
+        }
+        std::snprintf(lines[4].data(), lines[4].size(), "BINS  %10llu",
+                      static_cast<unsigned long long>(counters.bins_visited));
+        std::snprintf(lines[5].data(), lines[5].size(), "AABBS %10llu",
+                      static_cast<unsigned long long>(counters.aabb_tests));
+        std::snprintf(lines[6].data(), lines[6].size(), "KERNEL%10llu",
+                      static_cast<unsigned long long>(counters.kernel_calls));
+        std::snprintf(
+            lines[7].data(), lines[7].size(), "EARLY %10llu",
+            static_cast<unsigned long long>(counters.early_terminated_rays));
+
+        int const box_width = 17 * (overlay_glyph_width + 1) * overlay_scale;
+        for (int j = 0; j < line_count * line_height + overlay_scale; j++) {
+            for (int i = 0; i < box_width + overlay_scale; i++) {
+                if (i < width && j < height) {
+                    p_image[i + j * pitch] = background;
+                }
+            }
+        }
+        for (int i = 0; i < line_count; i++) {
+            draw_overlay_text(p_image, width, height, pitch, overlay_scale,
+                              overlay_scale + i * line_height,
+                              lines[i].data(), foreground);
+        }
+    }
+};
+
+inline Profiler profiler;
+
+// A thread's own `ProfileCounters`, which are registered with `profiler`
+// when the thread first counts, and unregistered when the thread exits so
+// that `profiler` never reads them after they are destroyed.
+struct ThreadProfileCounters {
+    ProfileCounters counters;
+    bool is_registered = false;
+
+    ~ThreadProfileCounters() {
+        if (is_registered) {
+            profiler.unregister_thread(counters);
+        }
+    }
+};
+
+inline thread_local ThreadProfileCounters profile_thread_counters;
+
+inline auto profile_counters() -> ProfileCounters& {
+    ThreadProfileCounters& thread_counters = profile_thread_counters;
+    if (!thread_counters.is_registered) [[unlikely]] {
+        profiler.register_thread(thread_counters.counters);
+        thread_counters.is_registered = true;
+    }
+    return thread_counters.counters;
+}
+
+// Adds the time until the end of its scope to a stage of this frame.
+struct ProfileScope {
+    ProfileStage stage;
+    std::chrono::steady_clock::time_point begin =
+        std::chrono::steady_clock::now();
+
+    explicit ProfileScope(ProfileStage const stage) : stage(stage) {
+    }
+
+    ~ProfileScope() {
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - begin;
+        profiler.add_stage_time(stage, elapsed.count());
+    }
+};
+
+// Time the rest of the enclosing scope as a `ProfileStage`.
+#define PROFILE_STAGE(stage) \
+    ProfileScope const profile_scope_##stage(ProfileStage::stage)
+// Add `amount` to one of this thread's `ProfileCounters`.
+#define PROFILE_COUNT(counter, amount) (profile_counters().counter += (amount))
+// Gather this frame's counters and begin the next frame.
+#define PROFILE_END_FRAME() profiler.end_frame()
+
+#else
+
+#define PROFILE_STAGE(stage)
+#define PROFILE_COUNT(counter, amount)
+#define PROFILE_END_FRAME()
+
+#endif
@@ -0,0 +1,2385 @@
+#pragma once
+
+// The renderer's world, and every stage of a frame: binning the view hash,
+// tracing primary rays, and lighting. `alternative` drives these from its
+// game loop, and `alternative_benchmark` times each of them.
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory_resource>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "./arena.hpp"
+#include "./profiler.hpp"
+#include "./sprites.hpp"
+#include "./thread_pool.hpp"
+
+
+template <typename T>
+struct Point {
+    T x, y, z;
+
+    auto operator==(Point<T> point) -> bool {
+        return point.x == this->x && point.y == this->y && point.z == this->z;
+    }
+
+    template <typename U>
+    explicit operator Point<U>() const {
+        return {
+            .x = static_cast<U>(this->x),
+            .y = static_cast<U>(this->y),
+            .z = static_cast<U>(this->z),
+        };
+    }
+};
+
+struct Ray {
+    Point<float> direction_inverse;
+    Point<short> origin;
+};
+
+// An axis-aligned box encoded by its least and greatest corners, rather than
+// by a corner and an extent, so that testing against it needs no additions.
+// Unlike `AABB`, this is not padded.
+struct BoundingBox {
+    Point<short> min;
+    Point<short> max;
+
+    auto intersect(Ray& ray) -> bool {
+        PROFILE_COUNT(aabb_tests, 1);
+        // Adapted from Fast, Branchless Ray/Bounding Box Intersections:
+        // https://tavianator.com/2011/ray_box.html
+        //
+        // ... with adjustments to better suit our use-case.
+        float min_distance;
+        float max_distance;
+
+        // X plane comparisons.
+        float intersect_x_1 = static_cast<float>(min.x - ray.origin.x) *
+                              ray.direction_inverse.x;
+        float intersect_x_2 = static_cast<float>(max.x - ray.origin.x) *
+                              ray.direction_inverse.x;
+
+        min_distance = std::min(intersect_x_1, intersect_x_2);
+        max_distance = std::max(intersect_x_1, intersect_x_2);
+
+        // Y plane comparisons.
+        float intersect_y_1 = static_cast<float>(min.y - ray.origin.y) *
+                              ray.direction_inverse.y;
+        float intersect_y_2 = static_cast<float>(max.y - ray.origin.y) *
+                              ray.direction_inverse.y;
+
+        min_distance = std::max<float>(min_distance,
+                                       std::min(intersect_y_1, intersect_y_2));
+        max_distance = std::min<float>(max_distance,
+                                       std::max(intersect_y_1, intersect_y_2));
+
+        // Z plane comparisons.
+        float intersect_z_1 = static_cast<float>(min.z - ray.origin.z) *
+                              ray.direction_inverse.z;
+        float intersect_z_2 = static_cast<float>(max.z - ray.origin.z) *
+                              ray.direction_inverse.z;
+
+        min_distance =
+            std::max(min_distance, std::min(intersect_z_1, intersect_z_2));
+        max_distance =
+            std::min(max_distance, std::max(intersect_z_1, intersect_z_2));
+
+        return max_distance >= min_distance;
+    }
+};
+
+static_assert(sizeof(BoundingBox) == 12);
+
+struct alignas(16) AABB {
+    // TODO: Update velocity with SIMD.
+    Point<short> position;
+    Point<short> extent;
+
+    auto bounding_box() const -> BoundingBox {
+        return {.min = position,
+                .max = {static_cast<short>(position.x + extent.x),
+                        static_cast<short>(position.y + extent.y),
+                        static_cast<short>(position.z + extent.z)}};
+    }
+
+    auto intersect(Ray& ray) -> bool {
+        return this->bounding_box().intersect(ray);
+    }
+};
+
+// Alignment pads this out from `12` bytes to `16`.
+// `16` divides evenly into a 64-byte cache line.
+static_assert(sizeof(AABB) == 16);
+
+constexpr Sprite tile_single = make_tile_floor();
+
+// The world index's chunks are `64` world units wide along `x` and `z`. A
+// power of `2` lets positions be floored into chunks with a shift.
+constexpr int world_chunk_shift = 6;
+
+// `WorldIndex` is a coarse grid of world-space chunks, which lists the
+// entities whose position lies in each chunk. That allows finding the
+// entities near the view without scanning every entity in the world. Chunks
+// span every `y` coordinate, and are only allocated once they are occupied.
+struct WorldIndex {
+    std::pmr::unordered_map<int, std::pmr::vector<int>> chunks;
+    // The chunk key of each entity, and its position in that chunk's list.
+    std::pmr::vector<int> entity_chunks;
+    std::pmr::vector<int> entity_slots;
+    // The largest `extent` of any indexed `AABB`, which lets queries
+    // conservatively find `AABB`s that reach into a region.
+    Point<short> max_extent = {0, 0, 0};
+
+    static constexpr int no_chunk = std::numeric_limits<int>::min();
+
+    explicit WorldIndex(std::pmr::memory_resource* p_memory)
+        : chunks(p_memory), entity_chunks(p_memory), entity_slots(p_memory) {
+    }
+
+    static auto chunk_key(int const chunk_x, int const chunk_z) -> int {
+        return (chunk_x << 16) ^ (chunk_z & 0xFFFF);
+    }
+
+    static auto chunk_of(int const world_position) -> int {
+        return world_position >> world_chunk_shift;
+    }
+
+    // Insert or re-index an entity, after its `AABB` has changed.
+    void update(int const entity_index, AABB const& aabb) {
+        if (entity_index >= static_cast<int>(entity_chunks.size())) {
+            entity_chunks.resize(entity_index + 1, no_chunk);
+            entity_slots.resize(entity_index + 1);
+        }
+        max_extent = {std::max(max_extent.x, aabb.extent.x),
+                      std::max(max_extent.y, aabb.extent.y),
+                      std::max(max_extent.z, aabb.extent.z)};
+
+        int key = chunk_key(chunk_of(aabb.position.x),
+                            chunk_of(aabb.position.z));
+        if (key == entity_chunks[entity_index]) {
+            return;
+        }
+        this->erase(entity_index);
+        std::pmr::vector<int>& chunk = chunks[key];
+        entity_chunks[entity_index] = key;
+        entity_slots[entity_index] = static_cast<int>(chunk.size());
+        chunk.push_back(entity_index);
+    }
+
+    void erase(int const entity_index) {
+        int key = entity_chunks[entity_index];
+        if (key == no_chunk) {
+            return;
+        }
+        // Swap the last entity in this chunk into the erased slot.
+        std::pmr::vector<int>& chunk = chunks[key];
+        int slot = entity_slots[entity_index];
+        chunk[slot] = chunk.back();
+        entity_slots[chunk[slot]] = slot;
+        chunk.pop_back();
+        entity_chunks[entity_index] = no_chunk;
+    }
+
+    // Call `callback` with the index of every entity whose position may lie
+    // within `[min_x, max_x]` and `[min_z, max_z]`.
+    void query(int const min_x, int const min_z, int const max_x,
+               int const max_z, std::invocable<int> auto callback) {
+        for (int chunk_x = chunk_of(min_x); chunk_x <= chunk_of(max_x);
+             chunk_x++) {
+            for (int chunk_z = chunk_of(min_z); chunk_z <= chunk_of(max_z);
+                 chunk_z++) {
+                auto chunk = chunks.find(chunk_key(chunk_x, chunk_z));
+                if (chunk == chunks.end()) {
+                    continue;
+                }
+                for (int entity_index : chunk->second) {
+                    callback(entity_index);
+                }
+            }
+        }
+    }
+};
+
+// Every container of `Entities` allocates from the same memory resource,
+// which is normally the world's arena.
+template <int entity_count>
+struct Entities {
+    std::pmr::vector<AABB> aabbs;
+    // Each entity's handle into `sprite_atlas`.
+    std::pmr::vector<SpriteIndex> sprites;
+    SpriteAtlas sprite_atlas;
+
+    int last_entity_index = 0;
+
+    // Entities which were inserted, moved or removed since the view hash
+    // last binned them.
+    std::pmr::vector<int> dirty_indices;
+    std::pmr::vector<bool> is_dirty;
+    // Removed entities keep their index, but are never binned.
+    std::pmr::vector<bool> is_removed;
+
+    WorldIndex world_index;
+
+    using Entity = struct {
+        AABB aabb;
+        // `0` is always `tile_single`.
+        SpriteIndex sprite = 0;
+    };
+
+    explicit Entities(std::pmr::memory_resource* p_memory)
+        : aabbs(p_memory),
+          sprites(p_memory),
+          sprite_atlas(p_memory),
+          dirty_indices(p_memory),
+          is_dirty(p_memory),
+          is_removed(p_memory),
+          world_index(p_memory) {
+        sprite_atlas.insert(tile_single);
+    }
+
+    void insert(Entity const entity) {
+        aabbs.push_back(entity.aabb);
+        sprites.push_back(entity.sprite);
+        is_dirty.push_back(false);
+        is_removed.push_back(false);
+        this->mark_dirty(last_entity_index);
+        last_entity_index += 1;
+    }
+
+    void remove(int const entity_index) {
+        is_removed[entity_index] = true;
+        world_index.erase(entity_index);
+        this->mark_dirty(entity_index);
+    }
+
+    void translate(int const entity_index, Point<short> const offset) {
+        Point<short>& position = aabbs[entity_index].position;
+        position = {static_cast<short>(position.x + offset.x),
+                    static_cast<short>(position.y + offset.y),
+                    static_cast<short>(position.z + offset.z)};
+        this->mark_dirty(entity_index);
+    }
+
+    // This must be called after an entity's `AABB` is mutated directly.
+    void mark_dirty(int const entity_index) {
+        if (!is_removed[entity_index]) {
+            world_index.update(entity_index, aabbs[entity_index]);
+        }
+        if (!is_dirty[entity_index]) {
+            is_dirty[entity_index] = true;
+            dirty_indices.push_back(entity_index);
+        }
+    }
+
+    void clear_dirty() {
+        for (int entity_index : dirty_indices) {
+            is_dirty[entity_index] = false;
+        }
+        dirty_indices.clear();
+    }
+
+    // Register a `Sprite` so that entities can refer to it by index.
+    auto insert_sprite(Sprite const& sprite) -> SpriteIndex {
+        return sprite_atlas.insert(sprite);
+    }
+
+    auto sprite(int const entity_index) -> Sprite& {
+        return sprite_atlas[sprites[entity_index]];
+    }
+
+    // No pixel of this entity's sprite has a smaller `depth` than this.
+    auto sprite_min_depth(int const entity_index) -> int {
+        return sprite_atlas.min_depths[sprites[entity_index]];
+    }
+
+    auto sprite_normals(int const entity_index)
+        -> std::array<NormalIndex, 20 * 40> const& {
+        return sprite_atlas.normal_indices[sprites[entity_index]];
+    }
+
+    auto size() -> int {
+        return last_entity_index;
+    }
+};
+
+constexpr int single_bin_cubic_size = 40;
+constexpr int view_width = 480;
+constexpr int view_height = 320;
+constexpr int view_length = 320;
+constexpr int hash_width = view_width / single_bin_cubic_size;
+constexpr int hash_height = view_height / single_bin_cubic_size;
+constexpr int hash_length = view_length / single_bin_cubic_size;
+constexpr int hash_volume = hash_width * hash_height * hash_length;
+
+// Currently, this number is no-op.
+constexpr int entity_count = view_width * view_length;
+
+// `intersect_aabbs()` tests this many `AABB`s against a ray at once.
+constexpr int aabb_lane_count = 8;
+
+// `AABBPlanes` holds the `BoundingBox`es of binned `AABB`s as a structure of
+// arrays, so that the same coordinate of consecutive boxes is contiguous.
+// Shadow rays read `float` planes, so that `intersect_aabbs()` can test many
+// boxes at once without converting them. A `float` represents every `short`
+// coordinate exactly.
+//
+// Each array is padded with `aabb_lane_count` trailing elements, so that a
+// full set of lanes may be loaded from any offset.
+template <typename Coordinate>
+struct AABBPlanes {
+    std::pmr::vector<Coordinate> min_x;
+    std::pmr::vector<Coordinate> min_y;
+    std::pmr::vector<Coordinate> min_z;
+    std::pmr::vector<Coordinate> max_x;
+    std::pmr::vector<Coordinate> max_y;
+    std::pmr::vector<Coordinate> max_z;
+
+    explicit AABBPlanes(std::pmr::memory_resource* p_memory)
+        : min_x(p_memory),
+          min_y(p_memory),
+          min_z(p_memory),
+          max_x(p_memory),
+          max_y(p_memory),
+          max_z(p_memory) {
+    }
+
+    void resize(int const size) {
+        for (std::pmr::vector<Coordinate>* p_plane :
+             {&min_x, &min_y, &min_z, &max_x, &max_y, &max_z}) {
+            p_plane->resize(size + aabb_lane_count);
+        }
+    }
+
+    void copy(int const to_index, int const from_index) {
+        for (std::pmr::vector<Coordinate>* p_plane :
+             {&min_x, &min_y, &min_z, &max_x, &max_y, &max_z}) {
+            (*p_plane)[to_index] = (*p_plane)[from_index];
+        }
+    }
+
+    void store(int const index, BoundingBox const& box) {
+        min_x[index] = box.min.x;
+        min_y[index] = box.min.y;
+        min_z[index] = box.min.z;
+        max_x[index] = box.max.x;
+        max_y[index] = box.max.y;
+        max_z[index] = box.max.z;
+    }
+};
+
+// Intersect `ray` with the `aabb_lane_count` `AABB`s starting from `offset`
+// in `bounds`, in the same manner as `BoundingBox::intersect()`. Returns a mask
+// where bit `n` is set if lane `n` was hit. Lanes beyond the end of a bin
+// must be masked out by the caller.
+//
+// `std::min(a, b)` is equivalent to `_mm_min_ps(b, a)`, including when either
+// is NaN, so operands are swapped here to exactly match the scalar path.
+#if defined(__AVX__)
+inline auto intersect_aabbs(AABBPlanes<float> const& bounds, int const offset,
+                            Ray const& ray) -> unsigned int {
+    __m256 origin_x = _mm256_set1_ps(ray.origin.x);
+    __m256 origin_y = _mm256_set1_ps(ray.origin.y);
+    __m256 origin_z = _mm256_set1_ps(ray.origin.z);
+    __m256 inverse_x = _mm256_set1_ps(ray.direction_inverse.x);
+    __m256 inverse_y = _mm256_set1_ps(ray.direction_inverse.y);
+    __m256 inverse_z = _mm256_set1_ps(ray.direction_inverse.z);
+
+    __m256 min_x = _mm256_loadu_ps(&bounds.min_x[offset]);
+    __m256 min_y = _mm256_loadu_ps(&bounds.min_y[offset]);
+    __m256 min_z = _mm256_loadu_ps(&bounds.min_z[offset]);
+    __m256 max_x = _mm256_loadu_ps(&bounds.max_x[offset]);
+    __m256 max_y = _mm256_loadu_ps(&bounds.max_y[offset]);
+    __m256 max_z = _mm256_loadu_ps(&bounds.max_z[offset]);
+
+    __m256 intersect_x_1 =
+        _mm256_mul_ps(_mm256_sub_ps(min_x, origin_x), inverse_x);
+    __m256 intersect_x_2 =
+        _mm256_mul_ps(_mm256_sub_ps(max_x, origin_x), inverse_x);
+    __m256 intersect_y_1 =
+        _mm256_mul_ps(_mm256_sub_ps(min_y, origin_y), inverse_y);
+    __m256 intersect_y_2 =
+        _mm256_mul_ps(_mm256_sub_ps(max_y, origin_y), inverse_y);
+    __m256 intersect_z_1 =
+        _mm256_mul_ps(_mm256_sub_ps(min_z, origin_z), inverse_z);
+    __m256 intersect_z_2 =
+        _mm256_mul_ps(_mm256_sub_ps(max_z, origin_z), inverse_z);
+
+    __m256 min_distance = _mm256_min_ps(intersect_x_2, intersect_x_1);
+    __m256 max_distance = _mm256_max_ps(intersect_x_2, intersect_x_1);
+    min_distance = _mm256_max_ps(
+        _mm256_min_ps(intersect_y_2, intersect_y_1), min_distance);
+    max_distance = _mm256_min_ps(
+        _mm256_max_ps(intersect_y_2, intersect_y_1), max_distance);
+    min_distance = _mm256_max_ps(
+        _mm256_min_ps(intersect_z_2, intersect_z_1), min_distance);
+    max_distance = _mm256_min_ps(
+        _mm256_max_ps(intersect_z_2, intersect_z_1), max_distance);
+
+    return static_cast<unsigned int>(_mm256_movemask_ps(
+        _mm256_cmp_ps(max_distance, min_distance, _CMP_GE_OQ)));
+}
+#elif defined(__SSE2__)
+inline auto intersect_aabbs(AABBPlanes<float> const& bounds, int const offset,
+                            Ray const& ray) -> unsigned int {
+    __m128 origin_x = _mm_set1_ps(ray.origin.x);
+    __m128 origin_y = _mm_set1_ps(ray.origin.y);
+    __m128 origin_z = _mm_set1_ps(ray.origin.z);
+    __m128 inverse_x = _mm_set1_ps(ray.direction_inverse.x);
+    __m128 inverse_y = _mm_set1_ps(ray.direction_inverse.y);
+    __m128 inverse_z = _mm_set1_ps(ray.direction_inverse.z);
+
+    unsigned int mask = 0;
+    // Test the lanes in two halves of four.
+    for (int lane = 0; lane < aabb_lane_count; lane += 4) {
+        __m128 min_x = _mm_loadu_ps(&bounds.min_x[offset + lane]);
+        __m128 min_y = _mm_loadu_ps(&bounds.min_y[offset + lane]);
+        __m128 min_z = _mm_loadu_ps(&bounds.min_z[offset + lane]);
+        __m128 max_x = _mm_loadu_ps(&bounds.max_x[offset + lane]);
+        __m128 max_y = _mm_loadu_ps(&bounds.max_y[offset + lane]);
+        __m128 max_z = _mm_loadu_ps(&bounds.max_z[offset + lane]);
+
+        __m128 intersect_x_1 =
+            _mm_mul_ps(_mm_sub_ps(min_x, origin_x), inverse_x);
+        __m128 intersect_x_2 =
+            _mm_mul_ps(_mm_sub_ps(max_x, origin_x), inverse_x);
+        __m128 intersect_y_1 =
+            _mm_mul_ps(_mm_sub_ps(min_y, origin_y), inverse_y);
+        __m128 intersect_y_2 =
+            _mm_mul_ps(_mm_sub_ps(max_y, origin_y), inverse_y);
+        __m128 intersect_z_1 =
+            _mm_mul_ps(_mm_sub_ps(min_z, origin_z), inverse_z);
+        __m128 intersect_z_2 =
+            _mm_mul_ps(_mm_sub_ps(max_z, origin_z), inverse_z);
+
+        __m128 min_distance = _mm_min_ps(intersect_x_2, intersect_x_1);
+        __m128 max_distance = _mm_max_ps(intersect_x_2, intersect_x_1);
+        min_distance =
+            _mm_max_ps(_mm_min_ps(intersect_y_2, intersect_y_1), min_distance);
+        max_distance =
+            _mm_min_ps(_mm_max_ps(intersect_y_2, intersect_y_1), max_distance);
+        min_distance =
+            _mm_max_ps(_mm_min_ps(intersect_z_2, intersect_z_1), min_distance);
+        max_distance =
+            _mm_min_ps(_mm_max_ps(intersect_z_2, intersect_z_1), max_distance);
+
+        mask |= static_cast<unsigned int>(
+                    _mm_movemask_ps(_mm_cmpge_ps(max_distance, min_distance)))
+                << lane;
+    }
+    return mask;
+}
+#else
+inline auto intersect_aabbs(AABBPlanes<float> const& bounds, int const offset,
+                            Ray const& ray) -> unsigned int {
+    unsigned int mask = 0;
+    for (int lane = 0; lane < aabb_lane_count; lane++) {
+        int index = offset + lane;
+        float intersect_x_1 =
+            (bounds.min_x[index] - ray.origin.x) * ray.direction_inverse.x;
+        float intersect_x_2 =
+            (bounds.max_x[index] - ray.origin.x) * ray.direction_inverse.x;
+        float intersect_y_1 =
+            (bounds.min_y[index] - ray.origin.y) * ray.direction_inverse.y;
+        float intersect_y_2 =
+            (bounds.max_y[index] - ray.origin.y) * ray.direction_inverse.y;
+        float intersect_z_1 =
+            (bounds.min_z[index] - ray.origin.z) * ray.direction_inverse.z;
+        float intersect_z_2 =
+            (bounds.max_z[index] - ray.origin.z) * ray.direction_inverse.z;
+
+        float min_distance = std::min(intersect_x_1, intersect_x_2);
+        float max_distance = std::max(intersect_x_1, intersect_x_2);
+        min_distance =
+            std::max(min_distance, std::min(intersect_y_1, intersect_y_2));
+        max_distance =
+            std::min(max_distance, std::max(intersect_y_1, intersect_y_2));
+        min_distance =
+            std::max(min_distance, std::min(intersect_z_1, intersect_z_2));
+        max_distance =
+            std::min(max_distance, std::max(intersect_z_1, intersect_z_2));
+
+        mask |= static_cast<unsigned int>(max_distance >= min_distance) << lane;
+    }
+    return mask;
+}
+#endif
+
+inline int mouse_x;
+inline int mouse_y;
+// The index of the pixel under the cursor, within the `GBuffer`.
+inline int mouse_pixel_index;
+
+// This function has no bounds checking. If bounds checking is required, it
+// should be handled explicitly in `pixel_callback`.
+template <typename T>
+void draw_line(int const x_start, int const y_start, int const x_end,
+               int const y_end, std::invocable<int, int, T> auto pixel_callback,
+               T const pixel_input) {
+    int x_delta = std::abs(x_end - x_start);
+    int y_delta = -std::abs(y_end - y_start);
+
+    int x = x_start;
+    int y = y_start;
+
+    int x_sign = x < x_end ? 1 : -1;
+    int y_sign = y < y_end ? 1 : -1;
+
+    int error = x_delta + y_delta;
+
+    while (true) {
+        pixel_callback(x, y, pixel_input);
+        if (x == x_end && y == y_end) {
+            return;
+        }
+        int error2 = 2 * error;
+        if (error2 >= y_delta) {
+            if (x == x_end) {
+                return;
+            }
+            error += y_delta;
+            x += x_sign;
+        }
+        if (error2 <= x_delta) {
+            if (y == y_end) {
+                return;
+            }
+            error += x_delta;
+            y += y_sign;
+        }
+    }
+}
+
+// The spatial hash is organized near-to-far, by bottom-to-top, by
+// left-to-right.
+// That is generally a cache-friendly layout for this data.
+inline auto index_into_view_hash(int x, int y, int z) -> int {
+    return (x * hash_height * hash_length) + (y * hash_length) + z;
+}
+
+// The range of bins, from `min` inclusive to `max` exclusive, that an `AABB`
+// spans across.
+struct BinRange {
+    Point<int> min;
+    Point<int> max;
+
+    auto is_empty() const -> bool {
+        return min.x >= max.x || min.y >= max.y || min.z >= max.z;
+    }
+};
+
+// Every bin of the view hash.
+constexpr BinRange view_bin_range = {
+    .min = {0, 0, 0}, .max = {hash_width, hash_height, hash_length}};
+
+// Every bin is allocated with this many spare slots, so that moving entities
+// can usually be re-binned in place.
+constexpr int bin_slack = 4;
+
+// The number of bins in one `x` slice of the view hash.
+constexpr int hash_slice_volume = hash_height * hash_length;
+
+// A slice's bins, and the slices, are each tracked by the bits of one word in
+// `ViewHash`'s occupancy masks.
+static_assert(hash_slice_volume <= 64 && hash_width < 64);
+
+// One entity in the primary visibility list of a column of bins.
+struct VisibilityEntry {
+    BoundingBox box;
+    // No pixel of this entity is deeper than this. It is the depth of the
+    // box's nearest corner, offset by the smallest `depth` of its sprite.
+    int max_depth;
+    int entity_index;
+    // Where this entity is first met when walking the column's bins from
+    // near to far, which breaks ties between equally deep pixels.
+    int order;
+};
+
+// The view hash's bins are stored in flat arrays, in the manner of a counting
+// sort. Bin `n` holds `counts[n]` `AABB`s, which begin at `offsets[n]` in
+// `entity_indices` and `bounds`, and it has room for `capacities[n]`. Bins
+// are sized by how many `AABB`s land in them, so they cannot overflow, and
+// memory grows only with the number of `AABB`s that are actually binned.
+//
+// Within a bin, `AABB`s are ordered by entity index. They are stored in world
+// space, while the bins themselves cover the view, which begins at `origin`.
+//
+// The per-bin arrays are fixed in size, so they are stored inline. Everything
+// which grows with the number of `AABB`s allocates from the memory resource
+// that the `ViewHash` is constructed with, which is normally the world's
+// arena. An arena never reclaims what these containers release, so they only
+// grow, and what they outgrow is not reused until the arena is reset.
+struct ViewHash {
+    std::array<int, hash_volume> counts{};
+    std::array<int, hash_volume> offsets{};
+    std::array<int, hash_volume> capacities{};
+    // How much of the flat arrays is allocated to bins, and how much of that
+    // belongs to bins which were scrolled out of view.
+    int used_size = 0;
+    int garbage_size = 0;
+
+    // The index of each binned `AABB` within `Entities`.
+    std::pmr::vector<int> entity_indices;
+    AABBPlanes<float> bounds;
+
+    // A two-level bitmask of which bins hold any `AABB`s, so that rays can
+    // skip runs of empty bins with bit scans rather than loading `counts`.
+    // Bit `y * hash_length + z` of `bin_occupancy[x]` is set if that bin is
+    // occupied, and bit `x` of `slice_occupancy` is set if any bin of that
+    // slice is. These are rebuilt by `update_occupancy()`.
+    std::array<std::uint64_t, hash_width> bin_occupancy{};
+    std::uint64_t slice_occupancy = 0;
+
+    // Primary rays all point along <0, -1, 1>, so every ray through the
+    // column of bins at `x`, `y` can only hit entities from those bins. Each
+    // column lists them once, sorted by `max_depth` from deepest to
+    // shallowest, so that a ray can stop as soon as nothing further on could
+    // be deeper than its hit. These are rebuilt by `update_visibility()`.
+    std::pmr::vector<std::pmr::vector<VisibilityEntry>> columns;
+
+    // The world-space position of the camera, which is the view's corner.
+    Point<int> origin = {0, 0, 0};
+
+    // The bins that each entity was last placed into. The `x` axis of these
+    // is offset by `scrolled_slices`, so that they remain valid as the view
+    // scrolls.
+    std::pmr::vector<BinRange> entity_bin_ranges;
+    int scrolled_slices = 0;
+    // Every entity which may have a non-empty bin range. Their ranges are
+    // reset on a full build.
+    std::pmr::vector<int> tracked_entities;
+    std::pmr::vector<bool> is_tracked;
+    bool is_built = false;
+
+    // A range covering every bin whose contents changed since the last
+    // `clear_changes()`. Rebuilding or scrolling changes all of them.
+    BinRange changed_range = {};
+    bool is_all_changed = true;
+
+    explicit ViewHash(std::pmr::memory_resource* p_memory)
+        : entity_indices(p_memory),
+          bounds(p_memory),
+          columns(hash_width * hash_height, p_memory),
+          entity_bin_ranges(p_memory),
+          tracked_entities(p_memory),
+          is_tracked(p_memory) {
+    }
+
+    void mark_changed(BinRange const& range) {
+        if (range.is_empty()) {
+            return;
+        }
+        if (changed_range.is_empty()) {
+            changed_range = range;
+            return;
+        }
+        changed_range.min.x = std::min(changed_range.min.x, range.min.x);
+        changed_range.min.y = std::min(changed_range.min.y, range.min.y);
+        changed_range.min.z = std::min(changed_range.min.z, range.min.z);
+        changed_range.max.x = std::max(changed_range.max.x, range.max.x);
+        changed_range.max.y = std::max(changed_range.max.y, range.max.y);
+        changed_range.max.z = std::max(changed_range.max.z, range.max.z);
+    }
+
+    void clear_changes() {
+        changed_range = {};
+        is_all_changed = false;
+    }
+
+    void track(int const entity_index) {
+        if (entity_index >= static_cast<int>(is_tracked.size())) {
+            is_tracked.resize(entity_index + 1);
+        }
+        if (!is_tracked[entity_index]) {
+            is_tracked[entity_index] = true;
+            tracked_entities.push_back(entity_index);
+        }
+    }
+
+    void untrack_all() {
+        for (int entity_index : tracked_entities) {
+            entity_bin_ranges[entity_index] = {};
+            is_tracked[entity_index] = false;
+        }
+        tracked_entities.clear();
+    }
+
+    // Reserve space at the end of the flat arrays for a bin with room for
+    // `capacity` `AABB`s.
+    void allocate(int const hash_bin_index, int const capacity) {
+        offsets[hash_bin_index] = used_size;
+        capacities[hash_bin_index] = capacity;
+        counts[hash_bin_index] = 0;
+        used_size += capacity;
+    }
+
+    void reserve_allocations() {
+        entity_indices.resize(used_size);
+        bounds.resize(used_size);
+    }
+
+    // This must be called after bins are filled or emptied.
+    void update_occupancy() {
+        slice_occupancy = 0;
+        for (int x = 0; x < hash_width; x++) {
+            std::uint64_t bits = 0;
+            for (int k = 0; k < hash_slice_volume; k++) {
+                bits |= std::uint64_t{counts[x * hash_slice_volume + k] != 0}
+                        << k;
+            }
+            bin_occupancy[x] = bits;
+            slice_occupancy |= std::uint64_t{bits != 0} << x;
+        }
+    }
+
+    auto column(int const x, int const y) const
+        -> std::pmr::vector<VisibilityEntry> const& {
+        return columns[x * hash_height + y];
+    }
+
+    // Rebuild the visibility lists of every column which `range` spans, from
+    // the `AABB`s in `p_entities`. This must be called after those bins are
+    // filled or emptied.
+    void update_visibility(Entities<entity_count>* p_entities,
+                           BinRange const& range) {
+        for (int x = std::max(0, range.min.x);
+             x < std::min(hash_width, range.max.x); x++) {
+            for (int y = std::max(0, range.min.y);
+                 y < std::min(hash_height, range.max.y); y++) {
+                this->update_column_visibility(p_entities, x, y);
+            }
+        }
+    }
+
+    void update_column_visibility(Entities<entity_count>* p_entities,
+                                  int const x, int const y) {
+        std::pmr::vector<VisibilityEntry>& entries =
+            columns[x * hash_height + y];
+        entries.clear();
+        for (int z = 0; z < hash_length; z++) {
+            int hash_bin_index = index_into_view_hash(x, y, z);
+            int begin = offsets[hash_bin_index];
+            int end = begin + counts[hash_bin_index];
+            for (int k = begin; k < end; k++) {
+                int entity_index = entity_indices[k];
+                BoundingBox box =
+                    p_entities->aabbs[entity_index].bounding_box();
+                // An entity which spans several bins of this column is
+                // listed from the nearest one, in the same manner as
+                // `aabb_to_bin_range()` finds it.
+                int first_bin_z = std::max(
+                    0, (box.min.z - origin.z) / single_bin_cubic_size);
+                if (first_bin_z != z) {
+                    continue;
+                }
+                entries.push_back({
+                    .box = box,
+                    .max_depth = box.min.y - box.min.z -
+                                 p_entities->sprite_min_depth(entity_index),
+                    .entity_index = entity_index,
+                    .order = static_cast<int>(entries.size()),
+                });
+            }
+        }
+        std::sort(entries.begin(), entries.end(),
+                  [](VisibilityEntry const& a, VisibilityEntry const& b) {
+                      return a.max_depth != b.max_depth
+                                 ? a.max_depth > b.max_depth
+                                 : a.order < b.order;
+                  });
+    }
+
+    auto is_occupied(int const x, int const y, int const z) const -> bool {
+        return (bin_occupancy[x] >> (y * hash_length + z) & 1u) != 0;
+    }
+
+    // Whether any bin within `range` is occupied. Only the occupied slices
+    // of `range` are visited, which are found with bit scans.
+    auto is_any_occupied(BinRange const& range) const -> bool {
+        int min_x = std::max(0, range.min.x);
+        int min_y = std::max(0, range.min.y);
+        int min_z = std::max(0, range.min.z);
+        int max_x = std::min(hash_width, range.max.x);
+        int max_y = std::min(hash_height, range.max.y);
+        int max_z = std::min(hash_length, range.max.z);
+        if (min_x >= max_x || min_y >= max_y || min_z >= max_z) {
+            return false;
+        }
+
+        std::uint64_t column_bits =
+            (std::uint64_t{1} << max_z) - (std::uint64_t{1} << min_z);
+        std::uint64_t slice_bits = 0;
+        for (int y = min_y; y < max_y; y++) {
+            slice_bits |= column_bits << (y * hash_length);
+        }
+        std::uint64_t slices =
+            slice_occupancy &
+            ((std::uint64_t{1} << max_x) - (std::uint64_t{1} << min_x));
+        while (slices != 0) {
+            int x = std::countr_zero(slices);
+            slices &= slices - 1;
+            if ((bin_occupancy[x] & slice_bits) != 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The bins an entity was last placed into, clipped to the current view.
+    auto entity_bin_range(int const entity_index) -> BinRange {
+        BinRange range = entity_bin_ranges[entity_index];
+        range.min.x = std::max(0, range.min.x - scrolled_slices);
+        range.max.x = std::min(hash_width, range.max.x - scrolled_slices);
+        return range;
+    }
+
+    void set_entity_bin_range(int const entity_index, BinRange range) {
+        range.min.x += scrolled_slices;
+        range.max.x += scrolled_slices;
+        entity_bin_ranges[entity_index] = range;
+    }
+
+    void store(int const hash_entity_index, int const entity_index,
+               AABB const& aabb) {
+        entity_indices[hash_entity_index] = entity_index;
+        bounds.store(hash_entity_index, aabb.bounding_box());
+    }
+
+    void copy(int const to_index, int const from_index) {
+        entity_indices[to_index] = entity_indices[from_index];
+        bounds.copy(to_index, from_index);
+    }
+
+    // Insert an `AABB` into a bin, preserving entity order. Returns `false` if
+    // the bin has no spare slots left.
+    auto insert(int const hash_bin_index, int const entity_index,
+                AABB const& aabb) -> bool {
+        if (counts[hash_bin_index] == capacities[hash_bin_index]) {
+            return false;
+        }
+        int begin = offsets[hash_bin_index];
+        int k = begin + counts[hash_bin_index];
+        for (; k > begin && entity_indices[k - 1] > entity_index; k--) {
+            this->copy(k, k - 1);
+        }
+        this->store(k, entity_index, aabb);
+        counts[hash_bin_index] += 1;
+        return true;
+    }
+
+    // Remove an entity's `AABB` from a bin, preserving entity order.
+    void erase(int const hash_bin_index, int const entity_index) {
+        int begin = offsets[hash_bin_index];
+        int end = begin + counts[hash_bin_index];
+        int k = begin;
+        while (k < end && entity_indices[k] != entity_index) {
+            k++;
+        }
+        if (k == end) {
+            return;
+        }
+        for (; k + 1 < end; k++) {
+            this->copy(k, k + 1);
+        }
+        counts[hash_bin_index] -= 1;
+    }
+};
+
+// Get the bins that the world-space box from `min` to `max` fits into, for a
+// view which begins at `origin`. Returns `false`, with an empty `range`, if it
+// fits entirely outside of the view bounds. This is computed in `int`, and
+// clamped to the view hash, so the box may extend beyond what a `short`
+// can hold.
+inline auto box_to_bin_range(Point<int> const min, Point<int> const max,
+                             Point<int> const origin, BinRange& range)
+    -> bool {
+    // These coordinates are relative to the view.
+    // The `y` coordinate shifts upwards as `z` increases.
+    int this_min_x_world = min.x - origin.x;
+    int this_min_y_world = min.y - origin.y;
+    int this_min_z_world = min.z - origin.z;
+
+    int this_max_x_world = max.x - origin.x;
+    int this_max_y_world = max.y - origin.y;
+    int this_max_z_world = max.z - origin.z;
+    int extent_z = max.z - min.z;
+
+    // TODO: Fix hard-coded numbers.
+    // Skip this box if it fits entirely outside of the view bounds.
+    if ((this_max_x_world < 0) || (this_min_x_world >= view_width) ||
+        (this_max_y_world < 0 - this_max_z_world) ||
+        (this_min_y_world >=
+         view_height - this_min_z_world + single_bin_cubic_size) ||
+        (this_max_z_world < -extent_z - single_bin_cubic_size) ||
+        (this_min_z_world > view_length + single_bin_cubic_size)) {
+        range = {};
+        return false;
+    }
+
+    range.min.x = std::max(0, this_min_x_world / single_bin_cubic_size);
+    range.min.y =
+        std::max(0, (view_height - this_max_y_world - this_max_z_world) /
+                        single_bin_cubic_size);
+    range.min.z = std::max(0, this_min_z_world / single_bin_cubic_size);
+
+    range.max.x =
+        std::min(hash_width, (this_max_x_world + single_bin_cubic_size - 1) /
+                                 single_bin_cubic_size);
+    range.max.y = std::min(
+        // `max.y` is rounded up to the nearest multiple of a bin's size.
+        hash_height, (view_height - this_min_y_world - this_min_z_world +
+                      single_bin_cubic_size - 1) /
+                         single_bin_cubic_size);
+    // `max.z` is rounded up to the nearest multiple of a bin's size.
+    range.max.z =
+        std::min(hash_length, (this_max_z_world + single_bin_cubic_size - 1) /
+                                  single_bin_cubic_size);
+    return true;
+}
+
+// Get the bins that `this_aabb` fits into, in the manner of
+// `box_to_bin_range()`.
+inline auto aabb_to_bin_range(AABB const& this_aabb, Point<int> const origin,
+                              BinRange& range) -> bool {
+    Point<int> min = static_cast<Point<int>>(this_aabb.position);
+    Point<int> max = {min.x + this_aabb.extent.x, min.y + this_aabb.extent.y,
+                      min.z + this_aabb.extent.z};
+    return box_to_bin_range(min, max, origin, range);
+}
+
+// Bin every entity in `candidates` into the slices `[slice_begin, slice_end)`
+// of the view hash, which must not already hold any `AABB`s. `candidates`
+// must be sorted, so that bins are filled in order of entity index.
+//
+// The first pass counts how many `AABB`s land in each bin, which gives each
+// bin's capacity, and the second pass scatters the `AABB`s into place.
+inline void fill_hash_slices(Entities<entity_count>* p_entities,
+                             ViewHash* p_view_hash,
+                             std::pmr::vector<int> const& candidates,
+                             int const slice_begin, int const slice_end) {
+    std::array<int, hash_volume>& counts = p_view_hash->counts;
+    int const hash_begin = slice_begin * hash_slice_volume;
+    int const hash_end = slice_end * hash_slice_volume;
+    std::fill(counts.begin() + hash_begin, counts.begin() + hash_end, 0);
+
+    for (int i : candidates) {
+        BinRange range;
+        aabb_to_bin_range(p_entities->aabbs[i], p_view_hash->origin, range);
+        p_view_hash->set_entity_bin_range(i, range);
+        p_view_hash->track(i);
+
+        for (int bin_x = std::max(slice_begin, range.min.x);
+             bin_x < std::min(slice_end, range.max.x); bin_x++) {
+            for (int bin_y = range.min.y; bin_y < range.max.y; bin_y++) {
+                for (int bin_z = range.min.z; bin_z < range.max.z; bin_z++) {
+                    counts[index_into_view_hash(bin_x, bin_y, bin_z)] += 1;
+                }
+            }
+        }
+    }
+
+    for (int i = hash_begin; i < hash_end; i++) {
+        p_view_hash->allocate(i, counts[i] + bin_slack);
+    }
+    p_view_hash->reserve_allocations();
+
+    for (int i : candidates) {
+        AABB& this_aabb = p_entities->aabbs[i];
+        BinRange range = p_view_hash->entity_bin_range(i);
+
+        // Place this `AABB` into every bin that it spans across.
+        for (int bin_x = std::max(slice_begin, range.min.x);
+             bin_x < std::min(slice_end, range.max.x); bin_x++) {
+            for (int bin_y = range.min.y; bin_y < range.max.y; bin_y++) {
+                for (int bin_z = range.min.z; bin_z < range.max.z; bin_z++) {
+                    int hash_bin_index =
+                        index_into_view_hash(bin_x, bin_y, bin_z);
+                    p_view_hash->store(p_view_hash->offsets[hash_bin_index] +
+                                           counts[hash_bin_index],
+                                       i, this_aabb);
+                    counts[hash_bin_index] += 1;
+                }
+            }
+        }
+    }
+}
+
+// Find the entities which may overlap the view slices `[slice_begin,
+// slice_end)` through the entities' `WorldIndex`, in ascending order. This
+// scales with the number of entities near the view rather than the size of
+// the world.
+inline void query_hash_slices(Entities<entity_count>* p_entities,
+                              ViewHash* p_view_hash, int const slice_begin,
+                              int const slice_end,
+                              std::pmr::vector<int>& candidates) {
+    // These bounds on an entity's position conservatively contain everything
+    // which `aabb_to_bin_range()` does not reject.
+    Point<int> origin = p_view_hash->origin;
+    Point<short> max_extent = p_entities->world_index.max_extent;
+    candidates.clear();
+    p_entities->world_index.query(
+        origin.x + slice_begin * single_bin_cubic_size - max_extent.x,
+        origin.z - 2 * max_extent.z - single_bin_cubic_size,
+        origin.x + slice_end * single_bin_cubic_size,
+        origin.z + view_length + single_bin_cubic_size,
+        [&](int const entity_index) {
+            candidates.push_back(entity_index);
+        });
+    std::sort(candidates.begin(), candidates.end());
+}
+
+// Sort every visible entity's `AABB` into the bins of `p_view_hash` from
+// scratch. Temporary lists are allocated from `p_frame_arena`.
+inline void count_entities_in_bins(Entities<entity_count>* p_entities,
+                                   ViewHash* p_view_hash,
+                                   Arena* p_frame_arena) {
+    p_view_hash->entity_bin_ranges.resize(p_entities->size());
+    p_view_hash->untrack_all();
+    p_view_hash->scrolled_slices = 0;
+    p_view_hash->used_size = 0;
+    p_view_hash->garbage_size = 0;
+
+    std::pmr::vector<int> candidates(p_frame_arena);
+    query_hash_slices(p_entities, p_view_hash, 0, hash_width, candidates);
+    fill_hash_slices(p_entities, p_view_hash, candidates, 0, hash_width);
+    p_view_hash->update_occupancy();
+    p_view_hash->update_visibility(p_entities, view_bin_range);
+
+    p_view_hash->is_built = true;
+    p_view_hash->is_all_changed = true;
+    p_entities->clear_dirty();
+}
+
+// Move the view to begin at `origin`. When the view scrolls along `x` by a
+// whole number of bins, the slices that remain in view are kept as they
+// are, and only the newly exposed slices are binned. Any other movement
+// rebuilds the view hash.
+inline void scroll_view_hash(Entities<entity_count>* p_entities,
+                             ViewHash* p_view_hash, Point<int> const origin,
+                             Arena* p_frame_arena) {
+    Point<int> distance = {origin.x - p_view_hash->origin.x,
+                           origin.y - p_view_hash->origin.y,
+                           origin.z - p_view_hash->origin.z};
+    if (distance.x == 0 && distance.y == 0 && distance.z == 0) {
+        return;
+    }
+
+    int scrolled_slices = distance.x / single_bin_cubic_size;
+    p_view_hash->origin = origin;
+    // Every pixel now sees a different part of the world.
+    p_view_hash->is_all_changed = true;
+    if (distance.y != 0 || distance.z != 0 ||
+        distance.x % single_bin_cubic_size != 0 ||
+        std::abs(scrolled_slices) >= hash_width) {
+        count_entities_in_bins(p_entities, p_view_hash, p_frame_arena);
+        return;
+    }
+
+    // Slices which leave the view are freed, and the rest are shifted
+    // towards the opposite side of the view.
+    int const kept_slices = hash_width - std::abs(scrolled_slices);
+    int const shift = scrolled_slices * hash_slice_volume;
+    int const exposed_begin = scrolled_slices > 0 ? kept_slices : 0;
+    int const exposed_end = exposed_begin + std::abs(scrolled_slices);
+    int const kept_volume = kept_slices * hash_slice_volume;
+
+    std::array<int, hash_volume>& capacities = p_view_hash->capacities;
+    for (int i = exposed_begin * hash_slice_volume;
+         i < exposed_end * hash_slice_volume; i++) {
+        // After the shift, the exposed slices are where freed slices were.
+        p_view_hash->garbage_size += capacities[(i + shift + hash_volume) %
+                                                hash_volume];
+    }
+
+    for (std::array<int, hash_volume>* p_bin_data :
+         {&p_view_hash->counts, &p_view_hash->offsets, &capacities}) {
+        if (shift > 0) {
+            std::copy(p_bin_data->begin() + shift, p_bin_data->end(),
+                      p_bin_data->begin());
+        } else {
+            std::copy_backward(p_bin_data->begin(),
+                               p_bin_data->begin() + kept_volume,
+                               p_bin_data->end());
+        }
+    }
+    p_view_hash->scrolled_slices += scrolled_slices;
+
+    std::pmr::vector<int> candidates(p_frame_arena);
+    query_hash_slices(p_entities, p_view_hash, exposed_begin, exposed_end,
+                      candidates);
+    fill_hash_slices(p_entities, p_view_hash, candidates, exposed_begin,
+                     exposed_end);
+
+    // Compact the bins once most of their storage is unused.
+    if (p_view_hash->garbage_size * 2 > p_view_hash->used_size) {
+        count_entities_in_bins(p_entities, p_view_hash, p_frame_arena);
+    }
+}
+
+// Re-bin only the entities which were inserted, moved or removed since the
+// last update, so that static geometry is binned once, then scroll the view
+// to begin at `camera`. This falls back on a full `count_entities_in_bins()`
+// when many entities changed, or when a bin runs out of spare slots.
+inline void update_bins(Entities<entity_count>* p_entities,
+                        ViewHash* p_view_hash, Point<int> const camera,
+                        Arena* p_frame_arena) {
+    std::pmr::vector<int>& dirty_indices = p_entities->dirty_indices;
+    if (!p_view_hash->is_built ||
+        static_cast<int>(dirty_indices.size()) * 4 > p_entities->size()) {
+        p_view_hash->origin = camera;
+        count_entities_in_bins(p_entities, p_view_hash, p_frame_arena);
+        return;
+    }
+
+    p_view_hash->entity_bin_ranges.resize(p_entities->size());
+
+    for (int i : dirty_indices) {
+        BinRange range = p_view_hash->entity_bin_range(i);
+        p_view_hash->mark_changed(range);
+        for (int bin_x = range.min.x; bin_x < range.max.x; bin_x++) {
+            for (int bin_y = range.min.y; bin_y < range.max.y; bin_y++) {
+                for (int bin_z = range.min.z; bin_z < range.max.z; bin_z++) {
+                    p_view_hash->erase(
+                        index_into_view_hash(bin_x, bin_y, bin_z), i);
+                }
+            }
+        }
+
+        if (p_entities->is_removed[i]) {
+            p_view_hash->set_entity_bin_range(i, {});
+            continue;
+        }
+
+        AABB& this_aabb = p_entities->aabbs[i];
+        aabb_to_bin_range(this_aabb, p_view_hash->origin, range);
+        p_view_hash->set_entity_bin_range(i, range);
+        p_view_hash->mark_changed(range);
+        p_view_hash->track(i);
+        for (int bin_x = range.min.x; bin_x < range.max.x; bin_x++) {
+            for (int bin_y = range.min.y; bin_y < range.max.y; bin_y++) {
+                for (int bin_z = range.min.z; bin_z < range.max.z; bin_z++) {
+                    if (!p_view_hash->insert(
+                            index_into_view_hash(bin_x, bin_y, bin_z), i,
+                            this_aabb)) {
+                        p_view_hash->origin = camera;
+                        count_entities_in_bins(p_entities, p_view_hash,
+                                               p_frame_arena);
+                        return;
+                    }
+                }
+            }
+        }
+    }
+
+    p_entities->clear_dirty();
+    scroll_view_hash(p_entities, p_view_hash, camera, p_frame_arena);
+    p_view_hash->update_occupancy();
+    p_view_hash->update_visibility(p_entities,
+                                   p_view_hash->is_all_changed
+                                       ? view_bin_range
+                                       : p_view_hash->changed_range);
+}
+
+// The `Pixel`s which primary rays hit, stored as a structure of arrays. The
+// lighting stage streams through every field of this each frame, so the
+// fields are kept as narrow as they can be.
+struct GBuffer {
+    static constexpr int size = view_width * view_height;
+
+    std::array<NormalIndex, size> normals;
+    std::array<Color, size> colors;
+    std::array<short, size> y;
+    std::array<short, size> z;
+    std::array<int, size> entity_indices;
+
+    void store(int const index, Pixel const& pixel) {
+        normals[index] = pixel.normal;
+        colors[index] = pixel.color;
+        y[index] = pixel.y;
+        z[index] = pixel.z;
+        entity_indices[index] = pixel.entity_index;
+    }
+
+    auto operator[](int const index) const -> Pixel {
+        return {.normal = normals[index],
+                .color = colors[index],
+                .y = y[index],
+                .z = z[index],
+                .entity_index = entity_indices[index]};
+    }
+};
+
+// Primary rays are traced in square tiles of pixels, which are the unit of
+// work handed to a `ThreadPool`.
+constexpr int trace_tile_size = 32;
+constexpr int trace_tiles_wide =
+    (view_width + trace_tile_size - 1) / trace_tile_size;
+constexpr int trace_tiles_high =
+    (view_height + trace_tile_size - 1) / trace_tile_size;
+constexpr int trace_tile_count = trace_tiles_wide * trace_tiles_high;
+
+// Within a tile, each column is traced in packets of this many vertically
+// adjacent rays. Those rays all walk the same visibility list.
+constexpr int trace_packet_size = 8;
+
+// A packet must never straddle two bins or two tiles.
+static_assert(single_bin_cubic_size % trace_packet_size == 0);
+static_assert(trace_tile_size % trace_packet_size == 0);
+
+// Trace a single primary ray through the column of pixels at `i`, `j`.
+inline auto trace_hash_for_pixel_ray(Entities<entity_count>* p_entities,
+                                     ViewHash* p_view_hash, short const i,
+                                     short const j) -> Pixel {
+    // Bins are relative to the view, but `AABB`s are in world space.
+    Point<int> origin = p_view_hash->origin;
+    int world_i = i + origin.x;
+    int world_j = view_height - j + origin.y + origin.z;
+    Pixel this_color = {.color = {255 / 2, 255 / 2, 255 / 2}};
+
+    int closest_entity_depth = std::numeric_limits<int>::min();
+    int closest_entity_order = 0;
+
+    // Every ray through this bin column may hit only the entities listed for
+    // it, and they are sorted from the greatest possible depth downwards.
+    std::pmr::vector<VisibilityEntry> const& column = p_view_hash->column(
+        i / single_bin_cubic_size, j / single_bin_cubic_size);
+    for (VisibilityEntry const& entry : column) {
+        // No entity from here on can be deeper than what was already hit.
+        if (entry.max_depth < closest_entity_depth) {
+            PROFILE_COUNT(early_terminated_rays, 1);
+            break;
+        }
+        PROFILE_COUNT(aabb_tests, 1);
+
+        BoundingBox const& box = entry.box;
+        // The point that `y` should intersect increases linearly with `z`.
+        int bottom = box.min.y + box.min.z;
+        int top = box.max.y + box.max.z;
+
+        // Intersect this ray with this `AABB`. Because the ray's slope is
+        // <0, -1, 1>, a rigorous intersection test is unnecessary.
+        if (world_i < box.min.x || world_i >= box.max.x || world_j <= bottom ||
+            world_j > top) {
+            continue;
+        }
+
+        Sprite& this_sprite = p_entities->sprite(entry.entity_index);
+        std::array<NormalIndex, 20 * 40> const& this_sprite_normals =
+            p_entities->sprite_normals(entry.entity_index);
+
+        int sprite_px_row = top - world_j;
+
+        // TODO: Make this more generic.
+        // `20` is the width of this sprite in pixels.
+        int this_sprite_px_index = sprite_px_row * 20 +
+                                   // Sprite pixel's column:
+                                   (world_i - box.min.x);
+
+        // Depth increases as `y` increases, and it decreases as `z`
+        // increases.
+        int this_depth =
+            // Position along this `AABB`'s `y` axis:
+            std::min<int>(box.min.y, box.max.y - sprite_px_row) - box.min.z
+            // Position along this `AABB`'s `z` axis:
+            - this_sprite.depth[this_sprite_px_index];
+
+        // Store the pixel with the greatest depth. Ties go to the entity
+        // which is nearest in bin order.
+        if (this_depth < closest_entity_depth ||
+            (this_depth == closest_entity_depth &&
+             entry.order > closest_entity_order)) {
+            continue;
+        }
+        closest_entity_depth = this_depth;
+        closest_entity_order = entry.order;
+
+        this_color.normal = this_sprite_normals[this_sprite_px_index];
+
+        this_color.color =
+            color_palette[this_sprite.color[this_sprite_px_index]];
+
+        this_color.y = static_cast<short>(
+            top - box.min.z - sprite_px_row -
+            this_sprite.depth[this_sprite_px_index]);
+        this_color.z = static_cast<short>(
+            box.min.z + this_sprite.depth[this_sprite_px_index]);
+
+        this_color.entity_index = entry.entity_index;
+    }
+
+    return this_color;
+}
+
+// Trace `trace_packet_size` primary rays at once, from `j_begin` upwards in
+// the column `i`. Every ray in the packet walks the same visibility list, so
+// each entry is loaded only once for the whole packet. The per-ray work is
+// written as fixed-width loops over lanes, which compilers vectorize.
+//
+// This produces exactly the same pixels as `trace_hash_for_pixel_ray()`.
+inline void trace_hash_for_pixel_packet(Entities<entity_count>* p_entities,
+                                        ViewHash* p_view_hash,
+                                        GBuffer* p_g_buffer, short const i,
+                                        short const j_begin) {
+    using Lanes = std::array<int, trace_packet_size>;
+
+    std::array<Pixel, trace_packet_size> colors;
+    Lanes world_j;
+    Lanes closest_entity_depth;
+    Lanes closest_entity_order;
+
+    // Bins are relative to the view, but `AABB`s are in world space.
+    Point<int> origin = p_view_hash->origin;
+    int world_i = i + origin.x;
+
+    for (int lane = 0; lane < trace_packet_size; lane++) {
+        colors[lane] = {.color = {255 / 2, 255 / 2, 255 / 2}};
+        world_j[lane] = view_height - (j_begin + lane) + origin.y + origin.z;
+        closest_entity_depth[lane] = std::numeric_limits<int>::min();
+        closest_entity_order[lane] = 0;
+    }
+    // The shallowest of the lanes' closest depths. Once no entity can be
+    // deeper than this, every lane is finished.
+    int shallowest_depth = std::numeric_limits<int>::min();
+
+    std::pmr::vector<VisibilityEntry> const& column = p_view_hash->column(
+        i / single_bin_cubic_size, j_begin / single_bin_cubic_size);
+    for (VisibilityEntry const& entry : column) {
+        if (entry.max_depth < shallowest_depth) {
+            PROFILE_COUNT(early_terminated_rays, trace_packet_size);
+            break;
+        }
+        PROFILE_COUNT(aabb_tests, trace_packet_size);
+
+        BoundingBox const& box = entry.box;
+        // Every lane shares the same `x`, so this is tested only once.
+        if (world_i < box.min.x || world_i >= box.max.x) {
+            continue;
+        }
+
+        int bottom = box.min.y + box.min.z;
+        int top = box.max.y + box.max.z;
+
+        Lanes is_covered;
+        unsigned int covered_mask = 0;
+        for (int lane = 0; lane < trace_packet_size; lane++) {
+            is_covered[lane] =
+                (world_j[lane] > bottom) & (world_j[lane] <= top);
+            covered_mask |= static_cast<unsigned int>(is_covered[lane]) << lane;
+        }
+        if (covered_mask == 0) {
+            continue;
+        }
+
+        Sprite& this_sprite = p_entities->sprite(entry.entity_index);
+        std::array<NormalIndex, 20 * 40> const& this_sprite_normals =
+            p_entities->sprite_normals(entry.entity_index);
+        int sprite_px_column = world_i - box.min.x;
+
+        // Uncovered lanes read row `0` of the sprite, which is always in
+        // bounds, and their result is discarded.
+        Lanes sprite_px_index;
+        Lanes sprite_depth;
+        Lanes this_depth;
+        unsigned int closer_mask = 0;
+        for (int lane = 0; lane < trace_packet_size; lane++) {
+            int sprite_px_row = (top - world_j[lane]) & -is_covered[lane];
+            sprite_px_index[lane] = sprite_px_row * 20 + sprite_px_column;
+            sprite_depth[lane] = this_sprite.depth[sprite_px_index[lane]];
+            this_depth[lane] =
+                std::min<int>(box.min.y, box.max.y - sprite_px_row) -
+                box.min.z - sprite_depth[lane];
+            int is_closer =
+                (this_depth[lane] > closest_entity_depth[lane]) |
+                ((this_depth[lane] == closest_entity_depth[lane]) &
+                 (entry.order < closest_entity_order[lane]));
+            closer_mask |=
+                static_cast<unsigned int>(is_covered[lane] & is_closer)
+                << lane;
+        }
+        if (closer_mask == 0) {
+            continue;
+        }
+
+        // Store the pixel with the greatest depth in each lane.
+        while (closer_mask != 0) {
+            int lane = std::countr_zero(closer_mask);
+            closer_mask &= closer_mask - 1;
+
+            int sprite_px_row = top - world_j[lane];
+            closest_entity_depth[lane] = this_depth[lane];
+            closest_entity_order[lane] = entry.order;
+            colors[lane].normal = this_sprite_normals[sprite_px_index[lane]];
+            colors[lane].color =
+                color_palette[this_sprite.color[sprite_px_index[lane]]];
+            colors[lane].y = static_cast<short>(
+                top - box.min.z - sprite_px_row - sprite_depth[lane]);
+            colors[lane].z =
+                static_cast<short>(box.min.z + sprite_depth[lane]);
+            colors[lane].entity_index = entry.entity_index;
+        }
+
+        shallowest_depth = closest_entity_depth[0];
+        for (int lane = 1; lane < trace_packet_size; lane++) {
+            shallowest_depth =
+                std::min(shallowest_depth, closest_entity_depth[lane]);
+        }
+    }
+
+    for (int lane = 0; lane < trace_packet_size; lane++) {
+        p_g_buffer->store((j_begin + lane) * view_width + i, colors[lane]);
+    }
+}
+
+// Trace the pixels within `[x_begin, x_end)` and `[y_begin, y_end)`. This
+// only reads from the bins and entities, so tiles may be traced
+// concurrently.
+inline void trace_hash_for_pixel_tile(Entities<entity_count>* p_entities,
+                                      ViewHash* p_view_hash,
+                                      GBuffer* p_g_buffer, short const x_begin,
+                                      short const y_begin, short const x_end,
+                                      short const y_end) {
+    // Rows below `packet_end` are traced in whole packets, and the rest one
+    // ray at a time.
+    auto packet_end = static_cast<short>(
+        y_begin + (y_end - y_begin) / trace_packet_size * trace_packet_size);
+
+    // `i` is a ray's `x` world-position ground, iterating
+    // rightwards.
+    for (short i = x_begin; i < x_end; i++) {
+        // `j` is a ray's `y` world-position, iterating upwards.
+        for (short j = y_begin; j < packet_end; j += trace_packet_size) {
+            trace_hash_for_pixel_packet(p_entities, p_view_hash, p_g_buffer,
+                                        i, j);
+        }
+        for (short j = packet_end; j < y_end; j++) {
+            // `j` decreases as the cursor moves downwards.
+            // `i` increases as the cursor moves rightwards.
+            p_g_buffer->store(
+                j * view_width + i,
+                trace_hash_for_pixel_ray(p_entities, p_view_hash, i, j));
+        }
+    }
+
+    if (mouse_x >= x_begin && mouse_x < x_end && mouse_y >= y_begin &&
+        mouse_y < y_end) {
+        mouse_pixel_index = mouse_y * view_width + mouse_x;
+    }
+}
+
+inline void trace_hash_for_pixel(Entities<entity_count>* p_entities,
+                                 ViewHash* p_view_hash, GBuffer* p_g_buffer) {
+    trace_hash_for_pixel_tile(p_entities, p_view_hash, p_g_buffer, 0, 0,
+                              view_width, view_height);
+
+    // // Draw hash grid.
+    // for (int i = 0; i < view_width; i++) {
+    //     for (int j = 0; j < view_height; j += single_bin_area) {
+    //         p_texture[j * view_width + i] = {0, 0, 0};
+    //     }
+    // }
+    // for (int i = 0; i < view_width; i += single_bin_area) {
+    //     for (int j = 0; j < view_height; j++) {
+    //         p_texture[j * view_width + i] = {0, 0, 0};
+    //     }
+    // }
+}
+
+// Trace every tile of the view across the workers of `thread_pool`. This
+// produces the same pixels as `trace_hash_for_pixel()`.
+inline void trace_hash_for_pixel(ThreadPool& thread_pool,
+                                 Entities<entity_count>* p_entities,
+                                 ViewHash* p_view_hash, GBuffer* p_g_buffer) {
+    thread_pool.parallel_for(trace_tile_count, [&](int const tile) {
+        auto x_begin =
+            static_cast<short>(tile % trace_tiles_wide * trace_tile_size);
+        auto y_begin =
+            static_cast<short>(tile / trace_tiles_wide * trace_tile_size);
+        trace_hash_for_pixel_tile(
+            p_entities, p_view_hash, p_g_buffer, x_begin, y_begin,
+            static_cast<short>(std::min(view_width, x_begin + trace_tile_size)),
+            static_cast<short>(
+                std::min(view_height, y_begin + trace_tile_size)));
+    });
+}
+
+// Map a world-space position into the continuous coordinates of a view hash
+// which begins at `origin`, measured in bins. The `y` axis of the hash shifts
+// downwards as `z` increases, which is a linear skew, so straight lines in
+// the world remain straight in this space.
+inline auto world_to_view_hash_space(int x, int y, int z,
+                                     Point<int> const origin) -> Point<float> {
+    x -= origin.x;
+    y -= origin.y;
+    z -= origin.z;
+    return {
+        .x = static_cast<float>(x) / single_bin_cubic_size,
+        .y = static_cast<float>(view_height - y - z) / single_bin_cubic_size,
+        .z = static_cast<float>(z) / single_bin_cubic_size,
+    };
+}
+
+// Walk the bins between `hash_start` and `hash_end` with an Amanatides-Woo
+// voxel traversal, as described in A Fast Voxel Traversal Algorithm for Ray
+// Tracing: http://www.cse.yorku.ca/~amana/research/grid.pdf
+//
+// Every bin that the segment passes through is visited exactly once, in
+// order, and the traversal terminates on the first obstruction. Returns
+// `true` if nothing obstructs `ray`.
+inline auto trace_hash_for_light(ViewHash* p_view_hash,
+                                 Point<float> const hash_start,
+                                 Point<float> const hash_end,
+                                 int const start_entity_index, Ray& ray)
+    -> bool {
+    Point<int> current_bin = {static_cast<int>(std::floor(hash_start.x)),
+                              static_cast<int>(std::floor(hash_start.y)),
+                              static_cast<int>(std::floor(hash_start.z))};
+    Point<int> end_bin = {static_cast<int>(std::floor(hash_end.x)),
+                          static_cast<int>(std::floor(hash_end.y)),
+                          static_cast<int>(std::floor(hash_end.z))};
+
+    Point<float> distance = {hash_end.x - hash_start.x,
+                             hash_end.y - hash_start.y,
+                             hash_end.z - hash_start.z};
+
+    Point<int> step = {(distance.x > 0) - (distance.x < 0),
+                       (distance.y > 0) - (distance.y < 0),
+                       (distance.z > 0) - (distance.z < 0)};
+
+    // `t` parameterizes the segment from `0` at its start to `1` at its end.
+    // `t_delta` is how far `t` advances to cross one whole bin along an axis,
+    // and `t_max` is the value of `t` at the next bin boundary on that axis.
+    constexpr float infinity = std::numeric_limits<float>::infinity();
+    Point<float> t_delta = {
+        step.x != 0 ? std::abs(1.f / distance.x) : infinity,
+        step.y != 0 ? std::abs(1.f / distance.y) : infinity,
+        step.z != 0 ? std::abs(1.f / distance.z) : infinity,
+    };
+    Point<float> t_max = {
+        step.x > 0   ? (current_bin.x + 1 - hash_start.x) * t_delta.x
+        : step.x < 0 ? (hash_start.x - current_bin.x) * t_delta.x
+                     : infinity,
+        step.y > 0   ? (current_bin.y + 1 - hash_start.y) * t_delta.y
+        : step.y < 0 ? (hash_start.y - current_bin.y) * t_delta.y
+                     : infinity,
+        step.z > 0   ? (current_bin.z + 1 - hash_start.z) * t_delta.z
+        : step.z < 0 ? (hash_start.z - current_bin.z) * t_delta.z
+                     : infinity,
+    };
+
+    // Stepping one axis at a time crosses exactly this many bins, so the
+    // traversal cannot overshoot the end even with rounding error.
+    int bins_to_visit = std::abs(end_bin.x - current_bin.x) +
+                        std::abs(end_bin.y - current_bin.y) +
+                        std::abs(end_bin.z - current_bin.z);
+    if (bins_to_visit == 0) {
+        return true;
+    }
+
+    auto step_to_next_bin = [&] {
+        if (t_max.x <= t_max.y && t_max.x <= t_max.z) {
+            current_bin.x += step.x;
+            t_max.x += t_delta.x;
+        } else if (t_max.y <= t_max.z) {
+            current_bin.y += step.y;
+            t_max.y += t_delta.y;
+        } else {
+            current_bin.z += step.z;
+            t_max.z += t_delta.z;
+        }
+    };
+
+    // The starting bin is skipped, to prevent self-intersection.
+    step_to_next_bin();
+
+    // Nothing can obstruct a segment if every bin that it visits is empty,
+    // which is common for short shadow rays over open floor. Each step only
+    // moves towards `end_bin`, so those bins all lie between the first
+    // stepped bin and `end_bin`. The starting bin is excluded, because it
+    // almost always holds the surface which the segment leaves from.
+    BinRange segment_range = {
+        .min = {std::min(current_bin.x, end_bin.x),
+                std::min(current_bin.y, end_bin.y),
+                std::min(current_bin.z, end_bin.z)},
+        .max = {std::max(current_bin.x, end_bin.x) + 1,
+                std::max(current_bin.y, end_bin.y) + 1,
+                std::max(current_bin.z, end_bin.z) + 1},
+    };
+    if (!p_view_hash->is_any_occupied(segment_range)) {
+        return true;
+    }
+
+    for (int i = 0; i < bins_to_visit; i++) {
+        if (i != 0) {
+            step_to_next_bin();
+        }
+
+        // Geometry outside of the view hash is never binned.
+        if (current_bin.x < 0 || current_bin.x >= hash_width ||
+            current_bin.y < 0 || current_bin.y >= hash_height ||
+            current_bin.z < 0 || current_bin.z >= hash_length) {
+            continue;
+        }
+        if (!p_view_hash->is_occupied(current_bin.x, current_bin.y,
+                                      current_bin.z)) {
+            continue;
+        }
+
+        int hash_bin_index =
+            index_into_view_hash(current_bin.x, current_bin.y, current_bin.z);
+
+        // Terminate this ray if it is obstructed in this bin.
+        // TODO: This hides the fact that sometimes unnecessary intersections
+        // are tested, because `AABB`s aligned to the grid get sorted in
+        // superfluous bins.
+        int bin_offset = p_view_hash->offsets[hash_bin_index];
+        int bin_count = p_view_hash->counts[hash_bin_index];
+        PROFILE_COUNT(bins_visited, 1);
+
+        for (int k = 0; k < bin_count; k += aabb_lane_count) {
+            PROFILE_COUNT(kernel_calls, 1);
+            PROFILE_COUNT(aabb_tests, std::min(aabb_lane_count, bin_count - k));
+            unsigned int hit_mask =
+                intersect_aabbs(p_view_hash->bounds, bin_offset + k, ray);
+            if (bin_count - k < aabb_lane_count) {
+                hit_mask &= (1u << (bin_count - k)) - 1u;
+            }
+
+            while (hit_mask != 0) {
+                int lane = std::countr_zero(hit_mask);
+                hit_mask &= hit_mask - 1;
+
+                // Prevent self-intersection.
+                if (start_entity_index !=
+                    p_view_hash->entity_indices[bin_offset + k + lane]) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+// A light whose `radius` is this reaches everything at full strength.
+constexpr short unbounded_light_radius = std::numeric_limits<short>::max();
+
+struct Light {
+    short x, y, z;
+    // Light fades out with distance, and reaches nothing `radius` or further
+    // away.
+    short radius = unbounded_light_radius;
+};
+
+constexpr float ambient_light = 0.25f;
+
+// How much of `light` reaches a point in world space. This falls smoothly
+// from `1` at the light to `0` at its radius.
+inline auto light_attenuation(Light const& light, int const x, int const y,
+                              int const z) -> float {
+    if (light.radius == unbounded_light_radius) {
+        return 1.f;
+    }
+    float distance_x = static_cast<float>(light.x - x);
+    float distance_y = static_cast<float>(light.y - y);
+    float distance_z = static_cast<float>(light.z - z);
+    float radius = light.radius;
+    float falloff = 1.f - (distance_x * distance_x + distance_y * distance_y +
+                           distance_z * distance_z) /
+                              (radius * radius);
+    return falloff > 0.f ? falloff * falloff : 0.f;
+}
+
+// The lights which can reach each bin of the view hash. Like the view hash's
+// own bins, bin `n` lists `counts[n]` lights from `offsets[n]` onwards in
+// `light_indices`.
+struct LightBins {
+    std::array<int, hash_volume> counts{};
+    std::array<int, hash_volume> offsets{};
+    std::pmr::vector<int> light_indices;
+    // Each light's position in the view hash's space.
+    std::pmr::vector<Point<float>> hash_positions;
+    // A hash of each bin's lights, which changes whenever any of them are
+    // added, removed, moved or resized.
+    std::array<std::uint64_t, hash_volume> signatures{};
+
+    explicit LightBins(std::pmr::memory_resource* p_memory)
+        : light_indices(p_memory), hash_positions(p_memory) {
+    }
+};
+
+// The range of bins which `light` can reach. Returns `false` if it cannot
+// reach any bin of the view.
+inline auto light_to_bin_range(Light const& light, Point<int> const origin,
+                               BinRange& range) -> bool {
+    if (light.radius == unbounded_light_radius) {
+        range = {.min = {0, 0, 0},
+                 .max = {hash_width, hash_height, hash_length}};
+        return true;
+    }
+    // A light's reach can extend beyond the range of a `short`, so it is
+    // kept in `int`.
+    Point<int> reach_min = {light.x - light.radius, light.y - light.radius,
+                            light.z - light.radius};
+    Point<int> reach_max = {light.x + light.radius, light.y + light.radius,
+                            light.z + light.radius};
+    return box_to_bin_range(reach_min, reach_max, origin, range);
+}
+
+// List every light under each bin that it can reach, so that pixels only
+// shadow-test the lights which might light them. The lists are built in two
+// passes like `fill_hash_slices()`, and each list is in order of light index.
+inline void bin_lights(std::vector<Light> const& lights, ViewHash* p_view_hash,
+                       LightBins* p_light_bins, Arena* p_frame_arena) {
+    std::array<int, hash_volume>& counts = p_light_bins->counts;
+    std::array<int, hash_volume>& offsets = p_light_bins->offsets;
+    std::fill(counts.begin(), counts.end(), 0);
+
+    std::pmr::vector<BinRange> ranges(lights.size(), p_frame_arena);
+    p_light_bins->hash_positions.resize(lights.size());
+    for (std::size_t i = 0; i < lights.size(); i++) {
+        Light const& light = lights[i];
+        p_light_bins->hash_positions[i] = world_to_view_hash_space(
+            light.x, light.y, light.z, p_view_hash->origin);
+        light_to_bin_range(light, p_view_hash->origin, ranges[i]);
+        for (int x = ranges[i].min.x; x < ranges[i].max.x; x++) {
+            for (int y = ranges[i].min.y; y < ranges[i].max.y; y++) {
+                for (int z = ranges[i].min.z; z < ranges[i].max.z; z++) {
+                    counts[index_into_view_hash(x, y, z)]++;
+                }
+            }
+        }
+    }
+
+    int size = 0;
+    for (int n = 0; n < hash_volume; n++) {
+        offsets[n] = size;
+        size += counts[n];
+        counts[n] = 0;
+    }
+    p_light_bins->light_indices.resize(size);
+
+    for (std::size_t i = 0; i < lights.size(); i++) {
+        for (int x = ranges[i].min.x; x < ranges[i].max.x; x++) {
+            for (int y = ranges[i].min.y; y < ranges[i].max.y; y++) {
+                for (int z = ranges[i].min.z; z < ranges[i].max.z; z++) {
+                    int n = index_into_view_hash(x, y, z);
+                    p_light_bins->light_indices[offsets[n] + counts[n]] =
+                        static_cast<int>(i);
+                    counts[n]++;
+                }
+            }
+        }
+    }
+
+    // This is the 64-bit FNV-1a hash.
+    for (int n = 0; n < hash_volume; n++) {
+        std::uint64_t signature = 0xcbf29ce484222325u;
+        auto hash = [&](int const value) {
+            signature = (signature ^ static_cast<std::uint32_t>(value)) *
+                        0x100000001b3u;
+        };
+        for (int k = 0; k < counts[n]; k++) {
+            int light_index = p_light_bins->light_indices[offsets[n] + k];
+            Light const& light = lights[light_index];
+            hash(light_index);
+            hash(light.x);
+            hash(light.y);
+            hash(light.z);
+            hash(light.radius);
+        }
+        p_light_bins->signatures[n] = signature;
+    }
+}
+
+// How many pixels trace their own shadow rays. The rest infer which lights
+// they can see from their neighbors, and only trace the lights which those
+// neighbors disagree on.
+enum class ShadowQuality {
+    // Every pixel traces its shadow rays.
+    full,
+    // Pixels where `x + y` is even trace their shadow rays.
+    checkerboard,
+    // Pixels where `x` and `y` are both even trace their shadow rays.
+    half,
+};
+
+// Read a `ShadowQuality` from its name, as given to `--shadows`. Returns
+// `false` if `name` is not one.
+inline auto parse_shadow_quality(std::string_view const name,
+                                 ShadowQuality& quality) -> bool {
+    if (name == "full") {
+        quality = ShadowQuality::full;
+    } else if (name == "checkerboard") {
+        quality = ShadowQuality::checkerboard;
+    } else if (name == "half") {
+        quality = ShadowQuality::half;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// The surface and lights that each pixel was last lit from. While those stay
+// the same, and no bin between the surface and those lights changes, the
+// pixel's shadow rays would find exactly the same obstructions again.
+struct ShadowCacheEntry {
+    NormalIndex normal;
+    int world_x, world_y, world_z;
+    int entity_index;
+    std::uint64_t light_signature;
+    // Bit `k` of `visibility` is set if the `k`th light of the pixel's bin
+    // is unobstructed, for the lights whose bit in `visibility_known` is set.
+    std::uint64_t visibility;
+    std::uint64_t visibility_known;
+    bool is_valid = false;
+};
+
+struct ShadowCache {
+    std::array<ShadowCacheEntry, view_width * view_height> entries{};
+    // The brightness that each pixel was last lit with. This is kept apart
+    // from `entries` so that shading streams through it contiguously.
+    std::array<float, view_width * view_height> brightness{};
+    // Entries lit at a different quality are discarded.
+    ShadowQuality quality = ShadowQuality::full;
+};
+
+// Whether the segment from `start` to `end` in the view hash's space passes
+// through any bin of `range`.
+inline auto segment_crosses_bin_range(Point<float> const start,
+                                      Point<float> const end,
+                                      BinRange const& range) -> bool {
+    float t_enter = 0.f;
+    float t_exit = 1.f;
+    auto clip = [&](float const from, float const to, int const min,
+                    int const max) -> bool {
+        // The range is widened slightly, so that rounding can never let a
+        // segment slip past a bin which `trace_hash_for_light()` visits.
+        float low = static_cast<float>(min) - 1e-3f;
+        float high = static_cast<float>(max) + 1e-3f;
+        float distance = to - from;
+        if (distance == 0.f) {
+            return from >= low && from <= high;
+        }
+        float t_low = (low - from) / distance;
+        float t_high = (high - from) / distance;
+        t_enter = std::max(t_enter, std::min(t_low, t_high));
+        t_exit = std::min(t_exit, std::max(t_low, t_high));
+        return t_enter <= t_exit;
+    };
+    return clip(start.x, end.x, range.min.x, range.max.x) &&
+           clip(start.y, end.y, range.min.y, range.max.y) &&
+           clip(start.z, end.z, range.min.z, range.max.z);
+}
+
+// The bin which holds a point in the view hash's space. Points beyond the
+// view are clamped into the nearest bin.
+inline auto hash_position_to_bin_index(Point<float> const hash_position)
+    -> int {
+    auto clamp_to_bins = [](float const position, int const bin_count) {
+        return std::clamp(static_cast<int>(std::floor(position)), 0,
+                          bin_count - 1);
+    };
+    return index_into_view_hash(clamp_to_bins(hash_position.x, hash_width),
+                                clamp_to_bins(hash_position.y, hash_height),
+                                clamp_to_bins(hash_position.z, hash_length));
+}
+
+// The index of the bin which holds a world-space position, in a view hash
+// which begins at `origin`, clamped in the same manner.
+inline auto world_to_view_hash_index(int const x, int const y, int const z,
+                                     Point<int> const origin) -> int {
+    return hash_position_to_bin_index(
+        world_to_view_hash_space(x, y, z, origin));
+}
+
+// Pixels are shaded in runs of this many at once. The per-pixel work is
+// written as fixed-width loops over lanes, which compilers vectorize.
+constexpr int shade_lane_count = 16;
+
+// Scale each pixel's color within the rows `[row_begin, row_end)` by its
+// brightness, clamped to `[0, 1]`, and write it into `p_texture`, whose rows
+// are `texture_pitch` `Color`s apart. Brightness is applied in 8.8 fixed
+// point, so each channel costs one 16-bit multiply and a shift, and alpha is
+// kept by scaling it by exactly `1`.
+inline void shade_rows(GBuffer const* p_g_buffer, float const* p_brightness,
+                       Color* p_texture, int const texture_pitch,
+                       int const row_begin, int const row_end) {
+    constexpr int channel_count = sizeof(Color);
+    static_assert(channel_count == 4);
+    constexpr std::uint16_t one = 256;
+
+    for (int row = row_begin; row < row_end; row++) {
+        auto const* p_colors = reinterpret_cast<unsigned char const*>(
+            p_g_buffer->colors.data() + row * view_width);
+        auto* p_output =
+            reinterpret_cast<unsigned char*>(p_texture + row * texture_pitch);
+        float const* p_row_brightness = p_brightness + row * view_width;
+
+        int i = 0;
+        for (; i + shade_lane_count <= view_width; i += shade_lane_count) {
+            std::array<std::uint16_t, shade_lane_count * channel_count> scale;
+            for (int lane = 0; lane < shade_lane_count; lane++) {
+                auto value = static_cast<std::uint16_t>(
+                    std::clamp(p_row_brightness[i + lane], 0.f, 1.f) * one);
+                scale[lane * channel_count + 0] = value;
+                scale[lane * channel_count + 1] = value;
+                scale[lane * channel_count + 2] = value;
+                scale[lane * channel_count + 3] = one;
+            }
+            // The lanes are staged in locals, so that the compiler need not
+            // prove that the G-buffer and texture never overlap.
+            std::array<unsigned char, shade_lane_count * channel_count> colors;
+            std::array<unsigned char, shade_lane_count * channel_count> shaded;
+            std::memcpy(colors.data(), p_colors + i * channel_count,
+                        colors.size());
+            for (std::size_t byte = 0; byte < colors.size(); byte++) {
+                shaded[byte] = static_cast<unsigned char>(
+                    (static_cast<std::uint16_t>(colors[byte]) * scale[byte]) >>
+                    8);
+            }
+            std::memcpy(p_output + i * channel_count, shaded.data(),
+                        shaded.size());
+        }
+        for (; i < view_width; i++) {
+            auto value = static_cast<std::uint16_t>(
+                std::clamp(p_row_brightness[i], 0.f, 1.f) * one);
+            for (int channel = 0; channel < channel_count - 1; channel++) {
+                p_output[i * channel_count + channel] =
+                    static_cast<unsigned char>(
+                        (p_colors[i * channel_count + channel] * value) >> 8);
+            }
+            p_output[i * channel_count + 3] = p_colors[i * channel_count + 3];
+        }
+    }
+}
+
+// Visibility can only be shared between pixels for this many of the lights
+// in a bin. Any more are always traced.
+constexpr int shared_visibility_light_count = 64;
+
+// Whether the pixel at `i` traces its own shadow rays at `quality`.
+inline auto is_shadow_sample(ShadowQuality const quality, int const i) -> bool {
+    int x = i % view_width;
+    int y = i / view_width;
+    switch (quality) {
+        case ShadowQuality::checkerboard:
+            return (x + y) % 2 == 0;
+        case ShadowQuality::half:
+            return x % 2 == 0 && y % 2 == 0;
+        default:
+            return true;
+    }
+}
+
+// Light the pixel at `i` by the lights of its bin, and return its brightness.
+// What it was lit from is written to `p_entry`. For each light whose bit in
+// `known_mask` is set, its visibility is taken from `known_visibility` rather
+// than traced.
+inline auto light_pixel(std::vector<Light> const& lights,
+                        LightBins const* p_light_bins, ViewHash* p_view_hash,
+                        Pixel const& this_pixel, int const i,
+                        std::uint64_t const known_mask,
+                        std::uint64_t const known_visibility,
+                        ShadowCacheEntry* p_entry) -> float {
+    Vector<float> normal = normal_palette[this_pixel.normal];
+
+    int world_x = i % view_width + p_view_hash->origin.x;
+    int world_y = this_pixel.y;
+    int world_z = this_pixel.z;
+
+    Point<float> ray_hash_position = world_to_view_hash_space(
+        world_x, world_y, world_z, p_view_hash->origin);
+    int bin_index = hash_position_to_bin_index(ray_hash_position);
+    int light_offset = p_light_bins->offsets[bin_index];
+    int light_count = p_light_bins->counts[bin_index];
+
+    // Every pixel has an ambient brightness, to which each light that
+    // is not obstructed adds.
+    float brightness = ambient_light;
+    std::uint64_t visibility = 0;
+    std::uint64_t visibility_known = 0;
+
+    for (int k = 0; k < light_count; k++) {
+        int light_index = p_light_bins->light_indices[light_offset + k];
+        Light const& light = lights[light_index];
+
+        float attenuation = light_attenuation(light, world_x, world_y, world_z);
+        if (attenuation <= 0.f) {
+            continue;
+        }
+
+        Vector towards_light =
+            Vector{.x = static_cast<float>(light.x - world_x),
+                   .y = static_cast<float>(light.y - world_y),
+                   .z = static_cast<float>(light.z - world_z)}
+                .normalize();
+
+        // Get the dot product between this pixel's normal and
+        // the light ray's incident vector.
+        float diffuse = std::max<float>(
+            0, normal.x * towards_light.x + normal.y * towards_light.y +
+                   normal.z * towards_light.z);
+        // A surface facing away from this light needs no shadow ray.
+        if (diffuse <= 0.f) {
+            continue;
+        }
+
+        std::uint64_t bit =
+            k < shared_visibility_light_count ? std::uint64_t{1} << k : 0;
+        bool is_visible;
+        if ((known_mask & bit) != 0) {
+            is_visible = (known_visibility & bit) != 0;
+        } else {
+            Ray this_ray = {
+                .direction_inverse = {.x = 1.f / towards_light.x,
+                                      .y = 1.f / towards_light.y,
+                                      .z = 1.f / towards_light.z},
+                .origin = {static_cast<short>(world_x),
+                           static_cast<short>(world_y),
+                           static_cast<short>(world_z)}};
+            is_visible = trace_hash_for_light(
+                p_view_hash, ray_hash_position,
+                p_light_bins->hash_positions[light_index],
+                this_pixel.entity_index, this_ray);
+        }
+
+        visibility_known |= bit;
+        if (is_visible) {
+            visibility |= bit;
+            brightness += diffuse * attenuation;
+        }
+    }
+
+    *p_entry = {
+        .normal = this_pixel.normal,
+        .world_x = world_x,
+        .world_y = world_y,
+        .world_z = world_z,
+        .entity_index = this_pixel.entity_index,
+        .light_signature = p_light_bins->signatures[bin_index],
+        .visibility = visibility,
+        .visibility_known = visibility_known,
+        .is_valid = true,
+    };
+    return brightness;
+}
+
+// Whether the cached lighting of the pixel at `i` is still correct.
+inline auto is_shadow_cached(LightBins const* p_light_bins,
+                             ViewHash* p_view_hash,
+                             ShadowCache const* p_shadow_cache,
+                             Pixel const& this_pixel, int const i) -> bool {
+    ShadowCacheEntry const& cached = p_shadow_cache->entries[i];
+    if (!cached.is_valid || p_view_hash->is_all_changed) {
+        return false;
+    }
+
+    int world_x = i % view_width + p_view_hash->origin.x;
+    Point<float> ray_hash_position = world_to_view_hash_space(
+        world_x, this_pixel.y, this_pixel.z, p_view_hash->origin);
+    int bin_index = hash_position_to_bin_index(ray_hash_position);
+    if (cached.entity_index != this_pixel.entity_index ||
+        cached.world_x != world_x || cached.world_y != this_pixel.y ||
+        cached.world_z != this_pixel.z ||
+        cached.normal != this_pixel.normal ||
+        cached.light_signature != p_light_bins->signatures[bin_index]) {
+        return false;
+    }
+
+    if (p_view_hash->changed_range.is_empty()) {
+        return true;
+    }
+    int light_offset = p_light_bins->offsets[bin_index];
+    for (int k = 0; k < p_light_bins->counts[bin_index]; k++) {
+        int light_index = p_light_bins->light_indices[light_offset + k];
+        if (segment_crosses_bin_range(ray_hash_position,
+                                      p_light_bins->hash_positions[light_index],
+                                      p_view_hash->changed_range)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Light the pixels within `[begin, end)` of `p_g_buffer` by every light
+// which reaches them, and shade them into `p_texture`, whose rows are
+// `texture_pitch` `Color`s apart. The range must cover whole rows. Pixels
+// whose entry in `p_shadow_cache` is still valid reuse their brightness
+// without tracing any shadow rays.
+//
+// Lighting at a reduced `quality` takes two passes over the whole view. The
+// first pass lights only the pixels which trace their own shadow rays. The
+// second lights every other pixel, and infers the visibility of each light
+// from the neighboring samples which show the same surface, with the same
+// normal, under the same lights. Where those samples disagree, or there are
+// none, the light is traced. Within a pass, every pixel is independent of
+// the others, so ranges may be lit concurrently.
+inline void light_pixel_range(std::vector<Light> const& lights,
+                              LightBins const* p_light_bins,
+                              ViewHash* p_view_hash,
+                              ShadowCache* p_shadow_cache,
+                              ShadowQuality const quality,
+                              bool const is_second_pass,
+                              GBuffer const* p_g_buffer, Color* p_texture,
+                              int const texture_pitch, int const begin,
+                              int const end) {
+    for (int i = begin; i < end; i++) {
+        if (is_shadow_sample(quality, i) == is_second_pass) {
+            continue;
+        }
+        Pixel this_pixel = (*p_g_buffer)[i];
+        ShadowCacheEntry& cached = p_shadow_cache->entries[i];
+
+        if (!is_shadow_cached(p_light_bins, p_view_hash, p_shadow_cache,
+                              this_pixel, i)) {
+            std::uint64_t any_known = 0;
+            std::uint64_t any_visible = 0;
+            std::uint64_t any_hidden = 0;
+            if (is_second_pass) {
+                int x = i % view_width;
+                int y = i / view_width;
+                // Bits of visibility refer to the lights of a bin in order, so
+                // they are only comparable between pixels lit by the same
+                // lists of lights.
+                int bin_index = world_to_view_hash_index(
+                    x + p_view_hash->origin.x, this_pixel.y, this_pixel.z,
+                    p_view_hash->origin);
+                std::uint64_t light_signature =
+                    p_light_bins->signatures[bin_index];
+                for (int j = std::max(0, y - 1);
+                     j <= std::min(view_height - 1, y + 1); j++) {
+                    for (int k = std::max(0, x - 1);
+                         k <= std::min(view_width - 1, x + 1); k++) {
+                        int neighbor = k + j * view_width;
+                        if (!is_shadow_sample(quality, neighbor)) {
+                            continue;
+                        }
+                        // The first pass left every sample's entry valid.
+                        ShadowCacheEntry const& sample =
+                            p_shadow_cache->entries[neighbor];
+                        if (sample.entity_index != this_pixel.entity_index ||
+                            sample.normal != this_pixel.normal ||
+                            sample.light_signature != light_signature) {
+                            continue;
+                        }
+                        any_known |= sample.visibility_known;
+                        any_visible |=
+                            sample.visibility_known & sample.visibility;
+                        any_hidden |=
+                            sample.visibility_known & ~sample.visibility;
+                    }
+                }
+            }
+            // Lights which the samples disagree on are traced.
+            std::uint64_t known_mask = any_known & ~(any_visible & any_hidden);
+            p_shadow_cache->brightness[i] =
+                light_pixel(lights, p_light_bins, p_view_hash, this_pixel, i,
+                            known_mask, any_visible & known_mask, &cached);
+        }
+    }
+
+    // Every pixel of the range is final after its last pass.
+    if (is_second_pass || quality == ShadowQuality::full) {
+        shade_rows(p_g_buffer, p_shadow_cache->brightness.data(), p_texture,
+                   texture_pitch, begin / view_width, end / view_width);
+    }
+}
+
+inline void light_pixels(std::vector<Light> const& lights,
+                         LightBins const* p_light_bins, ViewHash* p_view_hash,
+                         ShadowCache* p_shadow_cache,
+                         ShadowQuality const quality, GBuffer const* p_g_buffer,
+                         Color* p_texture, int const texture_pitch) {
+    if (p_shadow_cache->quality != quality) {
+        p_shadow_cache->quality = quality;
+        p_view_hash->is_all_changed = true;
+    }
+    light_pixel_range(lights, p_light_bins, p_view_hash, p_shadow_cache,
+                      quality, false, p_g_buffer, p_texture, texture_pitch, 0,
+                      view_width * view_height);
+    if (quality != ShadowQuality::full) {
+        light_pixel_range(lights, p_light_bins, p_view_hash, p_shadow_cache,
+                          quality, true, p_g_buffer, p_texture, texture_pitch,
+                          0, view_width * view_height);
+    }
+}
+
+// The lighting stage is split into bands of rows for a `ThreadPool`.
+constexpr int light_band_height = 8;
+constexpr int light_band_count =
+    (view_height + light_band_height - 1) / light_band_height;
+
+// Light every band of the view across the workers of `thread_pool`. This
+// produces the same texture as the serial `light_pixels()`.
+inline void light_pixels(ThreadPool& thread_pool,
+                         std::vector<Light> const& lights,
+                         LightBins const* p_light_bins, ViewHash* p_view_hash,
+                         ShadowCache* p_shadow_cache,
+                         ShadowQuality const quality, GBuffer const* p_g_buffer,
+                         Color* p_texture, int const texture_pitch) {
+    if (p_shadow_cache->quality != quality) {
+        p_shadow_cache->quality = quality;
+        p_view_hash->is_all_changed = true;
+    }
+    for (bool is_second_pass : {false, true}) {
+        if (is_second_pass && quality == ShadowQuality::full) {
+            break;
+        }
+        thread_pool.parallel_for(light_band_count, [&](int const band) {
+            int row_begin = band * light_band_height;
+            int row_end = std::min(view_height, row_begin + light_band_height);
+            light_pixel_range(lights, p_light_bins, p_view_hash,
+                              p_shadow_cache, quality, is_second_pass,
+                              p_g_buffer, p_texture, texture_pitch,
+                              row_begin * view_width, row_end * view_width);
+        });
+    }
+}
+
+// The world arena holds the entities, the view hash, the light bins, the
+// shadow cache and the G-buffer, along with every container that they own.
+// Those come to over ten megabytes, so its blocks are backed by huge pages.
+constexpr std::size_t world_arena_block_size = std::size_t{8} << 20;
+// The frame arena only holds lists of candidate entities and light ranges.
+constexpr std::size_t frame_arena_block_size = std::size_t{1} << 20;
+
+// Bin, trace and light one frame of the view from `camera` into `p_texture`,
+// whose rows are `texture_pitch` `Color`s apart. This writes every pixel of
+// the view, so `p_texture` may be write-only memory such as a locked
+// `SDL_Texture`. `p_frame_arena` is reset for the frame's temporaries.
+inline void render_frame(ThreadPool& thread_pool, bool const is_serial,
+                         Entities<entity_count>* p_entities,
+                         ViewHash* p_view_hash, LightBins* p_light_bins,
+                         ShadowCache* p_shadow_cache, Arena* p_frame_arena,
+                         ShadowQuality const shadow_quality,
+                         GBuffer* p_g_buffer, Color* p_texture,
+                         int const texture_pitch,
+                         std::vector<Light> const& lights,
+                         Point<int> const camera) {
+    p_frame_arena->reset();
+    {
+        PROFILE_STAGE(bin);
+        update_bins(p_entities, p_view_hash, camera, p_frame_arena);
+    }
+
+    {
+        PROFILE_STAGE(primary_trace);
+        if (is_serial) {
+            trace_hash_for_pixel(p_entities, p_view_hash, p_g_buffer);
+        } else {
+            trace_hash_for_pixel(thread_pool, p_entities, p_view_hash,
+                                 p_g_buffer);
+        }
+    }
+
+    {
+        PROFILE_STAGE(shadow_trace);
+        bin_lights(lights, p_view_hash, p_light_bins, p_frame_arena);
+        if (is_serial) {
+            light_pixels(lights, p_light_bins, p_view_hash, p_shadow_cache,
+                         shadow_quality, p_g_buffer, p_texture, texture_pitch);
+        } else {
+            light_pixels(thread_pool, lights, p_light_bins, p_view_hash,
+                         p_shadow_cache, shadow_quality, p_g_buffer, p_texture,
+                         texture_pitch);
+        }
+        // Every change to the bins has now been seen by the shadow cache.
+        p_view_hash->clear_changes();
+    }
+}
+
+// Insert the player, then the graybox world around it.
+inline void insert_graybox_world(Entities<entity_count>* p_entities) {
+    // Insert player:
+    p_entities->insert({
+        .aabb = {.position = {view_width / 2, 36, view_length / 4},
+                 .extent = {20, 20, 20}},
+    });
+
+    for (int i = 0; i < view_width; i++) {
+        for (int j = 0; j < view_length; j++) {
+            int x = i * 20;
+            int y = 0;
+            int z = j * 20;
+
+            if (x >= view_width / 2 - 40 && x < view_width / 2 + 40 &&
+                z < view_length / 2 + 40 && z > view_length / 2 - 40) {
+                continue;
+            }
+
+            Point<short> new_position = {static_cast<short>(x),
+                                         static_cast<short>(y),
+                                         static_cast<short>(z)};
+            p_entities->insert({
+                .aabb = {.position = {new_position.x, new_position.y,
+                                      new_position.z},
+                         .extent = {20, 20, 20}},
+            });
+        }
+    }
+
+    for (int i = 0; i < 6; i++) {
+        for (int j = 0; j < view_length - 10; j++) {
+            for (int k = 1; k < 6; k++) {
+                if (i >= 4 && k >= 4) {
+                    continue;
+                }
+                int x = i * 20;
+                int y = k * 20;
+                int z = view_length - j * 20;
+                Point<short> new_position = {static_cast<short>(x),
+                                             static_cast<short>(y),
+                                             static_cast<short>(z)};
+                p_entities->insert({
+                    .aabb = {.position = {new_position.x, new_position.y,
+                                          new_position.z},
+                             .extent = {20, 20, 20}},
+                });
+            }
+        }
+    }
+
+    for (int i = 1; i < 3; i++) {
+        for (int j = 0; j < view_length; j++) {
+            int x = view_width - i * 20;
+            int y = 20;
+            int z = j * 20;
+            Point<short> new_position = {static_cast<short>(x),
+                                         static_cast<short>(y),
+                                         static_cast<short>(z)};
+            p_entities->insert({
+                .aabb = {.position = {new_position.x, new_position.y,
+                                      new_position.z},
+                         .extent = {20, 20, 20}},
+            });
+        }
+    }
+
+    for (int i = 1; i < 20; i++) {
+        int x = view_width - 40 - i * 20;
+        int y = 20;
+        int z = view_length - 60;
+        Point<short> new_position = {static_cast<short>(x),
+                                     static_cast<short>(y),
+                                     static_cast<short>(z)};
+        p_entities->insert({
+            .aabb = {.position = {new_position.x, new_position.y,
+                                  new_position.z},
+                     .extent = {20, 20, 20}},
+        });
+    }
+}
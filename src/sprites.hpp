@@ -1,6 +1,12 @@
+#pragma once
+
+#include <algorithm>
 #include <array>
 #include <cmath>
 #include <limits>
+#include <memory_resource>
+#include <stdexcept>
+#include <vector>
 
 struct Color {
     unsigned char red, green, blue, alpha;
@@ -21,6 +27,8 @@ template <typename T = float>
 struct Vector {
     T x, y, z;
 
+    auto operator==(Vector const&) const -> bool = default;
+
     auto magnitude() -> T {
         return std::abs(x) + std::abs(y) + std::abs(z);
     }
@@ -50,10 +58,47 @@ struct Vector {
     }
 };
 
+// `NormalIndex` is a handle into a `NormalPalette`.
+using NormalIndex = unsigned char;
+
+// Sprites are drawn with very few distinct normals, so each is stored once
+// here and referred to everywhere else by a one-byte `NormalIndex`.
+struct NormalPalette {
+    static constexpr int capacity = 256;
+
+    // `0` is always the zero normal, which no light can reach.
+    std::array<Vector<float>, capacity> normals{};
+    int count = 1;
+
+    // Returns the index of an identical normal if one is already stored.
+    auto insert(Vector<float> const normal) -> NormalIndex {
+        for (int i = 0; i < count; i++) {
+            if (normals[i] == normal) {
+                return static_cast<NormalIndex>(i);
+            }
+        }
+        // Every `NormalIndex` is taken, so another normal would be written
+        // out of bounds and alias the zero normal.
+        if (count == capacity) {
+            throw std::length_error("A NormalPalette is out of normals.");
+        }
+        normals[count] = normal;
+        return static_cast<NormalIndex>(count++);
+    }
+
+    auto operator[](NormalIndex const index) const -> Vector<float> const& {
+        return normals[index];
+    }
+};
+
+inline NormalPalette normal_palette;
+
+// The surface which a primary ray hits. `y` and `z` are world-space
+// coordinates, which `AABB`s limit to the range of a `short`.
 struct Pixel {
-    Vector<float> normal;
+    NormalIndex normal;
     Color color;
-    int y, z;
+    short y, z;
     int entity_index;
 };
 
@@ -68,6 +113,64 @@ struct Sprite {
     std::array<int, 20 * 40> color;
     std::array<int, 20 * 40> depth;
     std::array<Vector<float>, 20 * 40> normal;
+
+    auto operator==(Sprite const&) const -> bool = default;
+};
+
+// `SpriteIndex` is a handle into a `SpriteAtlas`.
+using SpriteIndex = unsigned short;
+
+// A `SpriteAtlas` owns exactly one copy of every distinct `Sprite`. Entities
+// hold a `SpriteIndex` instead of their own `Sprite`, so memory scales with
+// the number of unique sprites rather than the number of entities.
+struct SpriteAtlas {
+    std::pmr::vector<Sprite> sprites;
+    // Each sprite's normals, as indices into `normal_palette`.
+    std::pmr::vector<std::array<NormalIndex, 20 * 40>> normal_indices;
+    // The smallest `depth` of any pixel of each sprite. Primary rays use this
+    // to bound how deep an entity can be, so `depth` may be any value.
+    std::pmr::vector<int> min_depths;
+
+    explicit SpriteAtlas(std::pmr::memory_resource* p_memory)
+        : sprites(p_memory), normal_indices(p_memory), min_depths(p_memory) {
+    }
+
+    // Returns the index of an identical `Sprite` if one is already stored.
+    // There are very few unique sprites, so a linear search is fine here.
+    auto insert(Sprite const& sprite) -> SpriteIndex {
+        for (std::size_t i = 0; i < sprites.size(); i++) {
+            if (sprites[i] == sprite) {
+                return static_cast<SpriteIndex>(i);
+            }
+        }
+        // Every `SpriteIndex` is taken, so another sprite would silently alias
+        // the first one.
+        if (sprites.size() > std::numeric_limits<SpriteIndex>::max()) {
+            throw std::length_error("A SpriteAtlas is out of sprite indices.");
+        }
+        // Everything which can throw is done before any vector grows, so that
+        // a full `normal_palette` leaves the atlas as it was.
+        std::array<NormalIndex, 20 * 40> indices;
+        for (std::size_t i = 0; i < indices.size(); i++) {
+            indices[i] = normal_palette.insert(sprite.normal[i]);
+        }
+        sprites.reserve(sprites.size() + 1);
+        normal_indices.reserve(normal_indices.size() + 1);
+        min_depths.reserve(min_depths.size() + 1);
+
+        sprites.push_back(sprite);
+        normal_indices.push_back(indices);
+        min_depths.push_back(std::ranges::min(sprite.depth));
+        return static_cast<SpriteIndex>(sprites.size() - 1);
+    }
+
+    auto operator[](SpriteIndex const index) -> Sprite& {
+        return sprites[index];
+    }
+
+    auto size() -> int {
+        return static_cast<int>(sprites.size());
+    }
 };
 
 constexpr auto make_tile_floor = []() -> Sprite {
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A persistent pool of worker threads which execute `parallel_for()` jobs.
+// Every job is a range of task indices. That range is dealt out evenly
+// between the workers up front, and a worker which runs out of tasks steals
+// the back half of another worker's remaining range.
+//
+// The thread calling `parallel_for()` participates as worker `0`, so a pool
+// of size `1` spawns no threads and runs everything serially.
+struct ThreadPool {
+    // Each worker's queue sits on its own cache line to prevent false
+    // sharing between workers that pop from their own queue.
+    struct alignas(64) TaskQueue {
+        std::mutex mutex;
+        int begin = 0;
+        int end = 0;
+    };
+
+    std::vector<std::thread> threads;
+    std::unique_ptr<TaskQueue[]> p_queues;
+    int thread_count;
+
+    std::function<void(int)> const* p_task = nullptr;
+    std::atomic<int> remaining_tasks = 0;
+
+    std::mutex mutex;
+    std::condition_variable wake_condition;
+    std::condition_variable done_condition;
+    unsigned int generation = 0;
+    bool is_stopping = false;
+
+    explicit ThreadPool(int const requested_thread_count)
+        : thread_count(std::max(1, requested_thread_count)) {
+        p_queues = std::make_unique<TaskQueue[]>(thread_count);
+        for (int i = 1; i < thread_count; i++) {
+            threads.emplace_back([this, i] {
+                this->work(i);
+            });
+        }
+    }
+
+    ThreadPool(ThreadPool const&) = delete;
+    auto operator=(ThreadPool const&) -> ThreadPool& = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(mutex);
+            is_stopping = true;
+        }
+        wake_condition.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    auto size() -> int {
+        return thread_count;
+    }
+
+    // Call `task(i)` once for every `i` in `[0, task_count)`, and block until
+    // all of them have finished.
+    void parallel_for(int const task_count,
+                      std::function<void(int)> const& task) {
+        if (task_count <= 0) {
+            return;
+        }
+
+        std::unique_lock lock(mutex);
+        p_task = &task;
+        remaining_tasks = task_count;
+
+        // Locking each queue publishes `p_task` to any worker which later
+        // pops from that queue.
+        for (int i = 0; i < thread_count; i++) {
+            std::lock_guard queue_lock(p_queues[i].mutex);
+            p_queues[i].begin = task_count * i / thread_count;
+            p_queues[i].end = task_count * (i + 1) / thread_count;
+        }
+
+        generation += 1;
+        lock.unlock();
+        wake_condition.notify_all();
+
+        this->run_tasks(0);
+
+        lock.lock();
+        done_condition.wait(lock, [this] {
+            return remaining_tasks == 0;
+        });
+        p_task = nullptr;
+    }
+
+  private:
+    void work(int const worker) {
+        unsigned int seen_generation = 0;
+        while (true) {
+            {
+                std::unique_lock lock(mutex);
+                wake_condition.wait(lock, [&] {
+                    return is_stopping || generation != seen_generation;
+                });
+                if (is_stopping) {
+                    return;
+                }
+                seen_generation = generation;
+            }
+            this->run_tasks(worker);
+        }
+    }
+
+    void run_tasks(int const worker) {
+        int task_index;
+        while (this->pop(worker, task_index) ||
+               this->steal(worker, task_index)) {
+            (*p_task)(task_index);
+            if (remaining_tasks.fetch_sub(1) == 1) {
+                std::lock_guard lock(mutex);
+                done_condition.notify_all();
+            }
+        }
+    }
+
+    // Take the next task from the front of this worker's own queue.
+    auto pop(int const worker, int& task_index) -> bool {
+        TaskQueue& queue = p_queues[worker];
+        std::lock_guard lock(queue.mutex);
+        if (queue.begin >= queue.end) {
+            return false;
+        }
+        task_index = queue.begin;
+        queue.begin += 1;
+        return true;
+    }
+
+    // Move the back half of another worker's queue into this worker's queue,
+    // then pop from it.
+    //
+    // A worker may still be stealing for one job when the next
+    // `parallel_for()` refills its queue. Both queues are therefore locked
+    // together, so that a refilled queue is popped from rather than
+    // overwritten, which would lose its tasks and never finish the job.
+    auto steal(int const worker, int& task_index) -> bool {
+        TaskQueue& queue = p_queues[worker];
+        for (int i = 1; i < thread_count; i++) {
+            TaskQueue& victim = p_queues[(worker + i) % thread_count];
+            std::scoped_lock lock(queue.mutex, victim.mutex);
+            if (queue.begin < queue.end) {
+                task_index = queue.begin;
+                queue.begin += 1;
+                return true;
+            }
+
+            int const victim_size = victim.end - victim.begin;
+            if (victim_size <= 0) {
+                continue;
+            }
+            int const stolen_begin = victim.end - (victim_size + 1) / 2;
+            queue.begin = stolen_begin + 1;
+            queue.end = victim.end;
+            victim.end = stolen_begin;
+            task_index = stolen_begin;
+            return true;
+        }
+        return false;
+    }
+};
+
+// A single persistent thread which runs one job at a time. `submit()` returns
+// as soon as the job is handed over, so the caller can overlap its own work
+// with the job until it calls `wait()`.
+struct JobThread {
+    std::thread thread;
+    std::function<void()> job;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool has_job = false;
+    bool is_stopping = false;
+
+    JobThread() {
+        thread = std::thread([this] {
+            this->work();
+        });
+    }
+
+    JobThread(JobThread const&) = delete;
+    auto operator=(JobThread const&) -> JobThread& = delete;
+
+    // A job which was submitted but not waited for still runs to completion.
+    ~JobThread() {
+        {
+            std::lock_guard lock(mutex);
+            is_stopping = true;
+        }
+        condition.notify_all();
+        thread.join();
+    }
+
+    // Run `new_job` on this thread. The previous job must have been waited
+    // for.
+    void submit(std::function<void()> new_job) {
+        {
+            std::lock_guard lock(mutex);
+            job = std::move(new_job);
+            has_job = true;
+        }
+        condition.notify_all();
+    }
+
+    // Block until the last submitted job has finished. This returns at once
+    // if there is none.
+    void wait() {
+        std::unique_lock lock(mutex);
+        condition.wait(lock, [this] {
+            return !has_job;
+        });
+    }
+
+  private:
+    void work() {
+        std::unique_lock lock(mutex);
+        while (true) {
+            condition.wait(lock, [this] {
+                return is_stopping || has_job;
+            });
+            if (!has_job) {
+                return;
+            }
+            lock.unlock();
+            job();
+            lock.lock();
+            has_job = false;
+            condition.notify_all();
+        }
+    }
+};
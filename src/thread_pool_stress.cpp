@@ -0,0 +1,41 @@
+// Runs many short `parallel_for()` jobs back to back on pools of several
+// sizes, and fails if any task runs other than exactly once. Small, uneven
+// jobs leave workers idle, so they steal often, and a worker which is still
+// stealing for one job can meet the next job's ranges. A lost range would
+// hang `parallel_for()`, so this is run with a timeout.
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+
+#include "./thread_pool.hpp"
+
+constexpr int stress_job_count = 50'000;
+constexpr int stress_max_task_count = 64;
+
+auto main() -> int {
+    for (int thread_count : {2, 3, 8, 16}) {
+        ThreadPool thread_pool(thread_count);
+        auto p_runs =
+            std::make_unique<std::atomic<int>[]>(stress_max_task_count);
+        for (int job = 0; job < stress_job_count; job++) {
+            int task_count = 1 + job % stress_max_task_count;
+            for (int i = 0; i < task_count; i++) {
+                p_runs[i] = 0;
+            }
+            thread_pool.parallel_for(task_count, [&](int const i) {
+                p_runs[i] += 1;
+            });
+            for (int i = 0; i < task_count; i++) {
+                if (p_runs[i] != 1) {
+                    std::fprintf(stderr,
+                                 "Task %d of job %d ran %d times on %d "
+                                 "threads.\n",
+                                 i, job, p_runs[i].load(), thread_count);
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}